@@ -52,6 +52,7 @@ const head = normalize(`
 #include "native.cc"
 
 #include "wrapping.hpp"
+#include "event-loop.hpp"
 
 namespace satori {
 `);
@@ -5,12 +5,89 @@ const
 
 generate({
 	globalFlush: new Fun("native::globalFlush()"),
+	listen: new Fun(
+		"event_loop::listen(isolate, Local<Function>::Cast(args[0]))"
+	),
+	unlisten: new Fun("event_loop::unlisten()"),
 	openFont: new Fun(
 		"RETURN(native::openFont(cpp<string>(args[0])))"
 	),
 	closeFont: new Fun(
 		"native::closeFont(cpp<uint>(args[0]))"
 	),
+	openFonts: new Fun(`
+		std::vector<string> names(args.Length());
+		for(int i = 0; i < args.Length(); ++i) {
+			names[i] = cpp<string>(args[i]);
+		}
+		
+		auto ids = native::openFonts(names);
+		auto arr = Array::New(isolate, ids.size());
+		
+		for(uint i = 0; i < ids.size(); ++i) {
+			arr->Set(i, JS(ids[i]));
+		}
+		
+		RETURN(arr);
+	`),
+	pollFont: new Fun(`
+		uint id;
+		string error;
+		
+		if(native::pollFont(id, error)) {
+			Local<Object> obj = OBJECT();
+			
+			obj->SET("id", id);
+			if(error.size()) {
+				obj->SET("error", error);
+			}
+			
+			RETURN(obj);
+		}
+	`),
+	// Convert a Uint32Array of RGBA words into another, with a kernel
+	//  chosen for the CPU unless one is given (for benchmarking)
+	convertPixels: new Fun(`
+		auto kind = (native::convert::Kind)cpp<uint>(args[0]);
+		auto kernel = args.Length() > 3?
+			(native::convert::Kernel)cpp<uint>(args[3]) :
+			native::convert::AUTO;
+		
+		size_t n_in, n_out;
+		auto* in = typed_array<uint32_t>(args[1], n_in);
+		auto* out = typed_array<uint32_t>(args[2], n_out);
+		
+		auto fn = native::convert::pick(kind, kernel);
+		if(!fn) {
+			throw std::runtime_error("Conversion kernel not supported");
+		}
+		fn(in, out, std::min(n_in, n_out));
+	`),
+	measureText: new Fun(`
+		RETURN(native::measureText(
+			cpp<uint>(args[0]), cpp<string>(args[1])
+		));
+	`),
+	measureTexts: new Fun(`
+		uint font = cpp<uint>(args[0]);
+		auto arr = Array::New(isolate, args.Length() - 1);
+		
+		for(int i = 1; i < args.Length(); ++i) {
+			arr->Set(i - 1, JS(
+				native::measureText(font, cpp<string>(args[i]))
+			));
+		}
+		
+		RETURN(arr);
+	`),
+	fontExtents: new Fun(`
+		uint ext = native::fontExtents(cpp<uint>(args[0]));
+		
+		Local<Object> obj = OBJECT();
+		obj->SET("ascent", ext>>16);
+		obj->SET("descent", ext&0xffff);
+		RETURN(obj);
+	`),
 		
 	pollEvent: new Fun(`
 		event::Any aev;
@@ -35,6 +112,8 @@ generate({
 					event::mouse::Wheel& ev = aev.mouse.wheel;
 					
 					obj->SET("delta", ev.delta);
+					obj->SET("x", ev.x);
+					obj->SET("y", ev.y);
 					break;
 				}
 				case event::MOUSE_PRESS: {
@@ -43,6 +122,8 @@ generate({
 					obj->SET("button", (int)ev.button);
 					obj->SET("state", ev.state);
 					obj->SET("dragging", ev.dragging);
+					obj->SET("x", ev.x);
+					obj->SET("y", ev.y);
 					break;
 				}
 				case event::MOUSE_HOVER: {
@@ -88,9 +169,15 @@ generate({
 					break;
 				}
 				
-				case event::WINDOW_DRAW: 
-					/* Nothing to add */
+				case event::WINDOW_DRAW: {
+					event::window::Draw ev = aev.window.draw;
+					
+					obj->SET("x", ev.x);
+					obj->SET("y", ev.y);
+					obj->SET("w", ev.w);
+					obj->SET("h", ev.h);
 					break;
+				}
 				
 				case event::WINDOW_OPEN:
 					/* Nothing to add */
@@ -99,6 +186,18 @@ generate({
 					/* Nothing to add */
 					break;
 				
+				case event::ERROR: {
+					event::Error ev = aev.error;
+					
+					obj->SET("error", ev.code);
+					obj->SET("major", ev.major);
+					obj->SET("minor", ev.minor);
+					obj->SET("site", ev.site);
+					obj->SET("resource", ev.resource);
+					obj->SET("sequence", ev.sequence);
+					break;
+				}
+				
 				case event::UNKNOWN:
 					break;
 			}
@@ -107,6 +206,240 @@ generate({
 		}
 	`),
 	
+	describeError: new Fun(`
+		RETURN(native::describeError(
+			cpp<int>(args[0]), cpp<int>(args[1]), cpp<int>(args[2]),
+			cpp<uint>(args[3]), cpp<uint>(args[4])
+		));
+	`),
+	
+	pollEvents: new Fun(`
+		// Each record is RECORD_LEN int32s: code and target followed
+		//  by the event's fields in the same order as pollEvent sets
+		//  them. Keep in sync with RECORD_LEN in lib/events.js
+		const uint RECORD_LEN = 8;
+		
+		size_t len;
+		auto* rec = typed_array<int32_t>(args[0], len);
+		
+		static std::vector<event::Any> evs;
+		evs.resize(len/RECORD_LEN);
+		memset(evs.data(), 0, evs.size()*sizeof(event::Any));
+		
+		uint n = native::pollEvents(evs.data(), evs.size());
+		
+		for(uint i = 0; i < n; ++i, rec += RECORD_LEN) {
+			event::Any& aev = evs[i];
+			
+			rec[0] = aev.code;
+			rec[1] = aev.target;
+			
+			switch(aev.code) {
+				case event::MOUSE_MOVE: {
+					event::mouse::Move& ev = aev.mouse.move;
+					
+					rec[2] = ev.x;
+					rec[3] = ev.y;
+					rec[4] = ev.dragging;
+					break;
+				}
+				case event::MOUSE_WHEEL: {
+					event::mouse::Wheel& ev = aev.mouse.wheel;
+					
+					rec[2] = ev.delta;
+					rec[3] = ev.x;
+					rec[4] = ev.y;
+					break;
+				}
+				case event::MOUSE_PRESS: {
+					event::mouse::Press& ev = aev.mouse.press;
+					
+					rec[2] = ev.button;
+					rec[3] = ev.state;
+					rec[4] = ev.dragging;
+					rec[5] = ev.x;
+					rec[6] = ev.y;
+					break;
+				}
+				case event::MOUSE_HOVER: {
+					event::mouse::Hover& ev = aev.mouse.hover;
+					
+					rec[2] = ev.x;
+					rec[3] = ev.y;
+					rec[4] = ev.state;
+					break;
+				}
+				
+				case event::KEY_PRESS: {
+					event::key::Press& ev = aev.key.press;
+					
+					rec[2] = ev.button;
+					rec[3] = ev.key;
+					rec[4] = ev.state;
+					// Modifiers are packed to fit the record
+					rec[5] =
+						ev.shift | ev.ctrl<<1 | ev.alt<<2 | ev.meta<<3;
+					break;
+				}
+				
+				case event::WINDOW_MOVE: {
+					event::window::Move ev = aev.window.move;
+					
+					rec[2] = ev.x;
+					rec[3] = ev.y;
+					break;
+				}
+				case event::WINDOW_RESIZE: {
+					event::window::Resize ev = aev.window.resize;
+					
+					rec[2] = ev.w;
+					rec[3] = ev.h;
+					break;
+				}
+				case event::WINDOW_FOCUS: {
+					event::window::Focus ev = aev.window.focus;
+					
+					rec[2] = ev.state;
+					break;
+				}
+				
+				case event::WINDOW_DRAW: {
+					event::window::Draw ev = aev.window.draw;
+					
+					rec[2] = ev.x;
+					rec[3] = ev.y;
+					rec[4] = ev.w;
+					rec[5] = ev.h;
+					break;
+				}
+				
+				case event::ERROR: {
+					event::Error ev = aev.error;
+					
+					rec[2] = ev.code;
+					rec[3] = ev.major;
+					rec[4] = ev.minor;
+					rec[5] = ev.site;
+					rec[6] = ev.resource;
+					rec[7] = ev.sequence;
+					break;
+				}
+				
+				case event::WINDOW_OPEN:
+				case event::WINDOW_CLOSE:
+				case event::UNKNOWN:
+					/* Nothing to add */
+					break;
+			}
+		}
+		
+		RETURN(n);
+	`),
+	
+	// The view tree of frames and windowless widgets, by node id
+	viewCreate: new Fun(`
+		RETURN(native::views.create(args.Length() > 0 && cpp<bool>(args[0])));
+	`),
+	viewDestroy: new Fun("native::views.destroy(cpp<uint>(args[0]))"),
+	viewInsert: new Fun(`
+		native::views.insert(
+			cpp<uint>(args[0]), cpp<uint>(args[1]),
+			args.Length() > 2? cpp<uint>(args[2]) : 0
+		);
+	`),
+	viewDetach: new Fun(`
+		uint id = cpp<uint>(args[0]);
+		if(native::views.alive(id)) {
+			native::views.detach(id);
+		}
+	`),
+	viewSetGeometry: new Fun(`
+		native::views.setGeometry(
+			cpp<uint>(args[0]),
+			cpp<int>(args[1]), cpp<int>(args[2]),
+			cpp<uint>(args[3]), cpp<uint>(args[4])
+		);
+	`),
+	viewSetLimits: new Fun(`
+		native::views.setLimits(
+			cpp<uint>(args[0]),
+			cpp<uint>(args[1]), cpp<uint>(args[2]),
+			cpp<uint>(args[3]), cpp<uint>(args[4])
+		);
+	`),
+	// Padding then margin, each as left, top, right, bottom
+	viewSetEdges: new Fun(`
+		native::views.setEdges(
+			cpp<uint>(args[0]),
+			native::ViewTree::Edges{
+				cpp<int>(args[1]), cpp<int>(args[2]),
+				cpp<int>(args[3]), cpp<int>(args[4])
+			},
+			native::ViewTree::Edges{
+				cpp<int>(args[5]), cpp<int>(args[6]),
+				cpp<int>(args[7]), cpp<int>(args[8])
+			}
+		);
+	`),
+	viewSetOrder: new Fun(`
+		native::views.setOrder(
+			cpp<uint>(args[0]), (native::ViewTree::Order)cpp<int>(args[1])
+		);
+	`),
+	// Column count, then a kind and value for each column and row
+	viewSetGrid: new Fun(`
+		typedef native::ViewTree::Grid::Track Track;
+		uint ncols = cpp<uint>(args[1]);
+		std::vector<Track> cols, rows;
+		
+		for(int i = 2; i + 1 < args.Length(); i += 2) {
+			Track t{(uint8_t)cpp<uint>(args[i]), cpp<uint>(args[i + 1])};
+			(cols.size() < ncols? cols : rows).push_back(t);
+		}
+		native::views.setGrid(cpp<uint>(args[0]), cols, rows);
+	`),
+	viewSetCell: new Fun(`
+		native::views.setCell(
+			cpp<uint>(args[0]),
+			cpp<uint>(args[1]), cpp<uint>(args[2]),
+			cpp<uint>(args[3]), cpp<uint>(args[4])
+		);
+	`),
+	// Int32Array of id, x, y, w, h for each node which moved or resized
+	viewLayout: new Fun(`
+		std::vector<int> list;
+		native::views.layout(
+			cpp<uint>(args[0]), cpp<uint>(args[1]), cpp<uint>(args[2]), list
+		);
+		
+		auto buf = ArrayBuffer::New(isolate, list.size()*sizeof(int));
+		memcpy(buf->GetContents().Data(), list.data(), list.size()*sizeof(int));
+		RETURN(Int32Array::New(buf, 0, list.size()));
+	`),
+	viewSetVisible: new Fun(`
+		native::views.setVisible(cpp<uint>(args[0]), cpp<bool>(args[1]));
+	`),
+	viewHitTest: new Fun(`
+		RETURN(native::views.hitTest(
+			cpp<uint>(args[0]), cpp<int>(args[1]), cpp<int>(args[2])
+		));
+	`),
+	// Int32Array of id, x, y for each node to paint, optionally only
+	//  those touching a region
+	viewPaintList: new Fun(`
+		const native::Region* clip = nullptr;
+		if(args.Length() > 1 && args[1]->IsObject()) {
+			clip = &NativeRegion::unwrap(args[1])->native;
+		}
+		
+		std::vector<int> list;
+		native::views.paintList(cpp<uint>(args[0]), clip, list);
+		
+		auto buf = ArrayBuffer::New(isolate, list.size()*sizeof(int));
+		memcpy(buf->GetContents().Data(), list.data(), list.size()*sizeof(int));
+		RETURN(Int32Array::New(buf, 0, list.size()));
+	`),
+	
 	NativeFrame: new Class("native::Frame", {
 		new: (`
 			//IsConstructCall check not included because it's extra
@@ -118,8 +451,10 @@ generate({
 				cpp<int>(args[1]), cpp<int>(args[2]),
 				// w, h
 				cpp<uint>(args[3]), cpp<uint>(args[4]),
-				// border width
-				cpp<uint>(args[5]), cpp<uint>(args[6])
+				// border width, background
+				cpp<uint>(args[5]), cpp<uint>(args[6]),
+				// ARGB visual
+				cpp<bool>(args[7])
 			);
 			nw->Wrap(THIS);
 			
@@ -131,12 +466,21 @@ generate({
 		constructor: (`
 			NativeFrame(
 				frame_id_t parent,
-				int x, int y, uint w, uint h, uint bw, uint bg
-			):native(parent, x, y, w, h, bw, bg) {}
+				int x, int y, uint w, uint h, uint bw, uint bg,
+				bool argb
+			):native(parent, x, y, w, h, bw, bg, argb) {}
 		`),
 		
 		close: "self.close()",
 		setBG: "self.setBG(cpp<uint>(args[0]))",
+		redrawArea: (`
+			self.redrawArea(
+				cpp<int>(args[0]), cpp<int>(args[1]),
+				cpp<uint>(args[2]), cpp<uint>(args[3])
+			);
+		`),
+		takeDamage:
+			"self.takeDamage(NativeRegion::unwrap(args[0])->native)",
 		getID: "RETURN(self.getID())",
 		setParent: "self.setParent(cpp<uint>(args[0]))",
 		
@@ -144,7 +488,7 @@ generate({
 		setVisible: "self.setVisible(cpp<bool>(args[0]))",
 		
 		getPosition: "RETURN(self.getPosition())",
-		setPosition: "self.setVisible(cpp<uint>(args[0]))",
+		setPosition: "self.setPosition(cpp<int>(args[0]))",
 		
 		getSize: "RETURN(self.getSize())",
 		setSize: "self.setSize(cpp<uint>(args[0]))",
@@ -158,10 +502,28 @@ generate({
 		maxColorMappings: "RETURN(self.maxColorMappings())",
 		
 		redraw: "self.redraw()",
+		setBuffered: "self.setBuffered(cpp<bool>(args[0]))",
+		present: "self.present()",
 		
 		allocColor: (`
 			RETURN(self.allocColor(cpp<uint>(args[0])));
 		`),
+		allocColors: (`
+			std::vector<uint> colors(args.Length());
+			
+			for(int i = 0; i < args.Length(); ++i) {
+				colors[i] = cpp<uint>(args[i]);
+			}
+			
+			auto pixels = self.allocColors(colors);
+			auto arr = Array::New(isolate, pixels.size());
+			
+			for(uint i = 0; i < pixels.size(); ++i) {
+				arr->Set(i, JS(pixels[i]));
+			}
+			
+			RETURN(arr);
+		`),
 		deallocColors: (`
 			std::vector<uint> colors(args.Length());
 			
@@ -173,6 +535,173 @@ generate({
 		`)
 	}),
 	
+	NativeRegion: new Class("native::Region", {
+		new: (`
+			auto* rgn = new NativeRegion();
+			rgn->Wrap(THIS);
+			
+			RETURN(THIS);
+		`),
+		constructor: (`
+			NativeRegion():native() {}
+		`),
+		
+		// Each op takes either another region or x, y, w, h
+		unite: (`
+			if(args.Length() == 1) {
+				self.unite(NativeRegion::unwrap(args[0])->native);
+				return;
+			}
+			self.unite(native::Region(
+				cpp<int>(args[0]), cpp<int>(args[1]),
+				cpp<uint>(args[2]), cpp<uint>(args[3])
+			));
+		`),
+		intersect: (`
+			if(args.Length() == 1) {
+				self.intersect(NativeRegion::unwrap(args[0])->native);
+				return;
+			}
+			self.intersect(native::Region(
+				cpp<int>(args[0]), cpp<int>(args[1]),
+				cpp<uint>(args[2]), cpp<uint>(args[3])
+			));
+		`),
+		subtract: (`
+			if(args.Length() == 1) {
+				self.subtract(NativeRegion::unwrap(args[0])->native);
+				return;
+			}
+			self.subtract(native::Region(
+				cpp<int>(args[0]), cpp<int>(args[1]),
+				cpp<uint>(args[2]), cpp<uint>(args[3])
+			));
+		`),
+		translate: "self.translate(cpp<int>(args[0]), cpp<int>(args[1]))",
+		clear: "self.clear()",
+		
+		isEmpty: "RETURN(self.empty())",
+		intersects: (`
+			RETURN(self.intersects(
+				cpp<int>(args[0]), cpp<int>(args[1]),
+				cpp<uint>(args[2]), cpp<uint>(args[3])
+			));
+		`),
+		getExtents: (`
+			auto e = self.extents();
+			
+			Local<Object> obj = OBJECT();
+			obj->SET("x", e.x1);
+			obj->SET("y", e.y1);
+			obj->SET("w", e.x2 - e.x1);
+			obj->SET("h", e.y2 - e.y1);
+			RETURN(obj);
+		`),
+		// Int32Array of x, y, w, h
+		getRects: (`
+			auto& boxes = self.boxes;
+			auto buf = ArrayBuffer::New(isolate, boxes.size()*4*sizeof(int));
+			auto* out = (int*)buf->GetContents().Data();
+			
+			for(auto& b : boxes) {
+				*(out++) = b.x1;
+				*(out++) = b.y1;
+				*(out++) = b.x2 - b.x1;
+				*(out++) = b.y2 - b.y1;
+			}
+			RETURN(Int32Array::New(buf, 0, boxes.size()*4));
+		`)
+	}),
+	
+	NativeImage: new Class("native::Image", {
+		new: (`
+			auto* img = new NativeImage(
+				cpp<uint>(args[0]), cpp<uint>(args[1]), cpp<bool>(args[2])
+			);
+			img->Wrap(THIS);
+			
+			RETURN(THIS);
+		`),
+		constructor: (`
+			NativeImage(uint w, uint h, bool argb):native(w, h, argb) {}
+			
+			// The buffer over the pixels, weak so it can be collected
+			//  while the image is in use
+			Persistent<ArrayBuffer> buffer;
+		`),
+		
+		// Whatever still views the pixels is cut off before they go
+		destroy: (`
+			if(!wrapper->buffer.IsEmpty()) {
+				Local<ArrayBuffer>::New(isolate, wrapper->buffer)->Neuter();
+				wrapper->buffer.Reset();
+			}
+			self.destroy();
+		`),
+		getStride: "RETURN(self.stride)",
+		getDepth: "RETURN(self.depth)",
+		isShared: "RETURN(self.isShared())",
+		writePixels: (`
+			size_t len;
+			auto* rgba = typed_array<uint32_t>(args[0], len);
+			
+			self.writePixels(rgba, len);
+		`),
+		isBusy: "RETURN(self.busy)",
+		sync: "self.sync()",
+		
+		// The pixels, in place, until destroy() empties the buffer. The
+		//  buffer keeps the image alive so the memory can't be freed by
+		//  the image being collected while it's still in use.
+		getData: (`
+			if(!self.data) {
+				return;
+			}
+			
+			Local<ArrayBuffer> buf;
+			if(wrapper->buffer.IsEmpty()) {
+				buf = ArrayBuffer::New(isolate, self.data, self.size);
+				
+				auto key = Private::ForApi(isolate, JS("satori::image"));
+				buf->SetPrivate(
+					isolate->GetCurrentContext(), key, args.Holder()
+				).FromJust();
+				
+				wrapper->buffer.Reset(isolate, buf);
+				wrapper->buffer.SetWeak();
+			}
+			else {
+				buf = Local<ArrayBuffer>::New(isolate, wrapper->buffer);
+			}
+			RETURN(Uint8Array::New(buf, 0, self.size));
+		`)
+	}),
+	
+	NativeRowIndex: new Class("native::RowIndex", {
+		new: (`
+			auto* ri = new NativeRowIndex(
+				cpp<uint>(args[0]), cpp<int>(args[1])
+			);
+			ri->Wrap(THIS);
+			
+			RETURN(THIS);
+		`),
+		constructor: (`
+			NativeRowIndex(uint n, int est):native(n, est) {}
+		`),
+		
+		getCount: "RETURN(self.n)",
+		setCount: "self.setCount(cpp<uint>(args[0]))",
+		getEstimate: "RETURN(self.estimate)",
+		
+		// Offsets can pass 2^31, so they go out as doubles
+		offset: "RETURN((double)self.offset(cpp<uint>(args[0])))",
+		total: "RETURN((double)self.total())",
+		height: "RETURN(self.height(cpp<uint>(args[0])))",
+		setHeight: "self.setHeight(cpp<uint>(args[0]), cpp<int>(args[1]))",
+		find: "RETURN(self.find((int64_t)cpp<double>(args[0])))"
+	}),
+	
 	NativeGraphicsContext: new Class("native::GraphicsContext", {
 		new: (`
 			//IsConstructCall check not included because it's extra
@@ -199,14 +728,54 @@ generate({
 		`),
 		
 		setFG: "self.setFG(cpp<uint>(args[0]))",
+		setAlpha: "self.setAlpha(cpp<uint>(args[0]))",
 		setBG: "self.setBG(cpp<uint>(args[0]))",
 		setLineWidth: "self.setLineWidth(cpp<uint>(args[0]))",
 		setFont: "self.setFont(cpp<uint>(args[0]))",
+		setLineStyle: "self.setLineStyle(cpp<uint>(args[0]))",
+		setCapStyle: "self.setCapStyle(cpp<uint>(args[0]))",
+		setJoinStyle: "self.setJoinStyle(cpp<uint>(args[0]))",
+		setFillStyle: "self.setFillStyle(cpp<uint>(args[0]))",
+		setClipOrigin:
+			"self.setClipOrigin(cpp<int>(args[0]), cpp<int>(args[1]))",
+		setArcMode: "self.setArcMode(cpp<uint>(args[0]))",
+		setDashes: (`
+			std::vector<uint8_t> dashes(args.Length() - 1);
+			
+			for(int i = 1; i < args.Length(); ++i) {
+				dashes[i - 1] = cpp<uint>(args[i]);
+			}
+			
+			self.setDashes(cpp<uint>(args[0]), dashes);
+		`),
+		
+		record: "self.record()",
+		submit: "self.submit(cpp<bool>(args[0]))",
+		
+		// A region to clip to, or nothing to stop clipping
+		setClip: (`
+			if(args.Length() && args[0]->IsObject()) {
+				self.setClip(&NativeRegion::unwrap(args[0])->native);
+			}
+			else {
+				self.setClip(nullptr);
+			}
+		`),
 		
 		drawPoints: (`
-			std::vector<display::Point> points(args.Length() - 1);
 			bool rel = cpp<bool>(args[0]);
 			
+			// Int16Array of x, y pairs, passed through as xcb_point_t
+			if(args.Length() == 2 && args[1]->IsArrayBufferView()) {
+				size_t len;
+				auto* data = typed_array<xcb_point_t>(args[1], len);
+				
+				self.drawPoints(rel, data, len);
+				return;
+			}
+			
+			std::vector<display::Point> points(args.Length() - 1);
+			
 			for(int i = 1; i < args.Length(); ++i) {
 				Local<Object> obj = cpp<Object>(args[i]);
 				points[i - 1] = display::Point{
@@ -217,9 +786,19 @@ generate({
 			self.drawPoints(rel, points);
 		`),
 		drawLines: (`
-			std::vector<display::Line> lines(args.Length() - 1);
 			bool rel = cpp<bool>(args[0]);
 			
+			// Int16Array of x1, y1, x2, y2, passed through as xcb_segment_t
+			if(args.Length() == 2 && args[1]->IsArrayBufferView()) {
+				size_t len;
+				auto* data = typed_array<xcb_segment_t>(args[1], len);
+				
+				self.drawLines(rel, data, len);
+				return;
+			}
+			
+			std::vector<display::Line> lines(args.Length() - 1);
+			
 			for(int i = 1; i < args.Length(); ++i) {
 				Local<Object> obj = cpp<Object>(args[i]);
 				lines[i - 1] = display::Line{
@@ -231,9 +810,19 @@ generate({
 			self.drawLines(rel, lines);
 		`),
 		drawRects: (`
-			std::vector<display::Rect> rects(args.Length() - 1);
 			bool fill = cpp<bool>(args[0]);
 			
+			// Int16Array of x, y, w, h, passed through as xcb_rectangle_t
+			if(args.Length() == 2 && args[1]->IsArrayBufferView()) {
+				size_t len;
+				auto* data = typed_array<xcb_rectangle_t>(args[1], len);
+				
+				self.drawRects(fill, data, len);
+				return;
+			}
+			
+			std::vector<display::Rect> rects(args.Length() - 1);
+			
 			for(int i = 1; i < args.Length(); ++i) {
 				Local<Object> obj = cpp<Object>(args[i]);
 				rects[i - 1] = display::Rect{
@@ -244,6 +833,15 @@ generate({
 			
 			self.drawRects(fill, rects);
 		`),
+		putImage: (`
+			auto* img = NativeImage::unwrap(args[0]);
+			
+			self.putImage(img->native,
+				cpp<int>(args[1]), cpp<int>(args[2]),
+				cpp<int>(args[3]), cpp<int>(args[4]),
+				cpp<uint>(args[5]), cpp<uint>(args[6])
+			);
+		`),
 		drawText: (`
 			int x = cpp<int>(args[0]), y = cpp<int>(args[1]);
 			string text = cpp<string>(args[2]);
@@ -0,0 +1,41 @@
+'use strict';
+
+const
+	{native} = require("./lib/native"),
+	{Image} = require("./lib/image");
+
+// One 1080p frame
+const N = 1920*1080, ROUNDS = 50;
+
+let src = new Uint32Array(N), dst = new Uint32Array(N);
+for(let i = 0; i < N; ++i) {
+	src[i] = (Math.random()*0x100000000)>>>0;
+}
+
+for(let conv in Image.CONVERSIONS) {
+	for(let kernel in Image.KERNELS) {
+		let
+			c = Image.CONVERSIONS[conv],
+			k = Image.KERNELS[kernel];
+		
+		try {
+			native.convertPixels(c, src, dst, k);
+		}
+		catch(e) {
+			console.log(`${conv}/${kernel}: not supported`);
+			continue;
+		}
+		
+		let start = process.hrtime();
+		for(let i = 0; i < ROUNDS; ++i) {
+			native.convertPixels(c, src, dst, k);
+		}
+		let [s, ns] = process.hrtime(start);
+		
+		let ms = (s*1e3 + ns/1e6)/ROUNDS;
+		console.log(
+			`${conv}/${kernel}: ${ms.toFixed(3)} ms/frame, ` +
+			`${(N*8/ms/1e6).toFixed(2)} GB/s`
+		);
+	}
+}
@@ -32,7 +32,9 @@
 				
 				"conditions": [
 					['xclient == "xcb"', {
-						"libraries": ["-lxcb", "-lxcb-ewmh"]
+						"libraries": [
+							"-lxcb", "-lxcb-ewmh", "-lxcb-render", "-lxcb-shm"
+						]
 					}],
 					['xclient == "xlib"', {
 						"libraries": ["-lX11"]
@@ -0,0 +1,120 @@
+#ifndef SATORI_EVENT_LOOP_HPP
+#define SATORI_EVENT_LOOP_HPP
+
+#include <uv.h>
+#include <node.h>
+
+/**
+ * Registers the X connection with Node's event loop so JS is only
+ *  woken when there's actually something to dispatch, rather than
+ *  polling the connection every tick.
+ *
+ * This file is intended to be included into the generated module,
+ *  after wrapping.hpp.
+**/
+namespace satori {
+namespace event_loop {
+	static uv_poll_t poll_handle;
+	static uv_prepare_t prepare_handle;
+	static Persistent<Function> callback;
+	static bool initialized = false, listening = false;
+	
+	void unlisten();
+	
+	void dispatch() {
+		auto* isolate = Isolate::GetCurrent();
+		HandleScope scope(isolate);
+		
+		auto cb = Local<Function>::New(isolate, callback);
+		node::MakeCallback(
+			isolate, isolate->GetCurrentContext()->Global(),
+			cb, 0, nullptr
+		);
+	}
+	
+	/**
+	 * Stop listening to a connection that can't be read any more, and
+	 *  hand the callback an Error saying why.
+	**/
+	void fail(const char* why) {
+		auto* isolate = Isolate::GetCurrent();
+		HandleScope scope(isolate);
+		
+		auto cb = Local<Function>::New(isolate, callback);
+		unlisten();
+		
+		Local<Value> argv[] = {Exception::Error(JS(why))};
+		node::MakeCallback(
+			isolate, isolate->GetCurrentContext()->Global(),
+			cb, 1, argv
+		);
+	}
+	
+	void on_readable(uv_poll_t* handle, int status, int events) {
+		// A closed or broken connection polls as readable forever
+		if(status < 0) {
+			fail(uv_strerror(status));
+		}
+		else if(auto* why = native::connectionError()) {
+			fail(why);
+		}
+		else {
+			dispatch();
+		}
+	}
+	
+	// Runs right before the loop blocks on the file descriptor
+	void on_prepare(uv_prepare_t* handle) {
+		// Events read off the socket during a reply won't make it
+		//  readable again, so they'd sit in the queue until the
+		//  server happened to send something else
+		while(native::eventsQueued()) {
+			dispatch();
+		}
+		
+		// Requests made outside of a dispatch still need to be sent
+		native::globalFlush();
+	}
+	
+	void listen(Isolate* isolate, Local<Function> cb) {
+		callback.Reset(isolate, cb);
+		
+		if(listening) {
+			return;
+		}
+		
+		if(!initialized) {
+			auto* loop = uv_default_loop();
+			
+			uv_poll_init(loop, &poll_handle, native::connectionFD());
+			uv_prepare_init(loop, &prepare_handle);
+			
+			// The poll handle alone decides whether Node stays alive
+			uv_unref((uv_handle_t*)&prepare_handle);
+			
+			initialized = true;
+		}
+		
+		uv_poll_start(&poll_handle, UV_READABLE, on_readable);
+		uv_prepare_start(&prepare_handle, on_prepare);
+		
+		listening = true;
+	}
+	
+	void unlisten() {
+		if(!listening) {
+			return;
+		}
+		
+		// Stopped handles don't keep the loop alive, so there's no
+		//  need to close them
+		uv_poll_stop(&poll_handle);
+		uv_prepare_stop(&prepare_handle);
+		
+		callback.Reset();
+		listening = false;
+	}
+}
+}
+
+#endif
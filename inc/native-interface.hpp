@@ -3,6 +3,8 @@
 
 #include <utility>
 #include <stdexcept>
+#include <vector>
+#include <cstdint>
 
 namespace satori {
 	typedef uint font_id_t;
@@ -17,7 +19,8 @@ namespace satori {
 			MOUSE_HOVER = 4,
 			KEY_PRESS = 5,
 			WINDOW_MOVE = 6, WINDOW_RESIZE = 7, WINDOW_FOCUS = 8,
-			WINDOW_DRAW = 9, WINDOW_OPEN = 10, WINDOW_CLOSE = 11
+			WINDOW_DRAW = 9, WINDOW_OPEN = 10, WINDOW_CLOSE = 11,
+			ERROR = 12
 		};
 		
 		namespace mouse {
@@ -31,13 +34,16 @@ namespace satori {
 				bool dragging;
 			};
 			
+			// Positions are relative to the target
 			struct Wheel {
 				int delta;
+				int x, y;
 			};
 			
 			struct Press {
 				Button button;
 				bool state, dragging;
+				int x, y;
 			};
 			
 			struct Hover {
@@ -103,8 +109,13 @@ namespace satori {
 				bool state;
 			};
 			
+			// Bounding box of the damaged area
 			struct Draw {
-			
+				int x, y;
+				uint w, h;
+				
+				// Exposures still to come in this series
+				uint count;
 			};
 			
 			struct Open {
@@ -116,6 +127,15 @@ namespace satori {
 			};
 		}
 		
+		// A request sent without waiting for its reply failed
+		struct Error {
+			int code, major, minor;
+			
+			// Which call site sent the request
+			uint site;
+			uint resource, sequence;
+		};
+		
 		// Combine all the events into one
 		struct Any {
 			Code code;
@@ -141,6 +161,8 @@ namespace satori {
 					window::Open open;
 					window::Close close;
 				} window;
+				
+				Error error;
 			};
 		};
 	}
@@ -174,24 +196,53 @@ namespace satori {
 			
 			font_id_t font;
 			
+			uint line_style, cap_style, join_style, fill_style;
+			int clip_x, clip_y;
+			
+			// Alternating dash and gap lengths
+			uint dash_offset;
+			std::vector<uint8_t> dashes;
+			
+			uint arc_mode;
+			
+			// Opacity of the foreground. Anything under 255 is drawn
+			//  through RENDER, since core drawing can't blend.
+			uint8_t alpha;
+			
 			/**
 			 * TODO:
 			 *  Composition function (GX)
-			 *  line style
-			 *  cap style
-			 *  join style
-			 *  fill style
 			 *  tiling/stipling
 			 *  subwindow mode
-			 *  clipping
-			 *  arc mode
+			 *  clip mask
 			 *  generate exposure events
 			**/
 			
+			// Everything past the font starts at X's defaults
 			Style(
 				color_id_t fg, color_id_t bg,
 				uint lw, font_id_t font
-			):fg(fg), bg(bg), line_width(lw), font(font) {}
+			):fg(fg), bg(bg), line_width(lw), font(font),
+				line_style(0), cap_style(1), join_style(0), fill_style(0),
+				clip_x(0), clip_y(0),
+				dash_offset(0), dashes{4},
+				arc_mode(1), alpha(0xff) {}
+			
+			bool operator==(const Style& o) const {
+				return
+					fg == o.fg && bg == o.bg &&
+					line_width == o.line_width && font == o.font &&
+					line_style == o.line_style &&
+					cap_style == o.cap_style &&
+					join_style == o.join_style &&
+					fill_style == o.fill_style &&
+					clip_x == o.clip_x && clip_y == o.clip_y &&
+					dash_offset == o.dash_offset && dashes == o.dashes &&
+					arc_mode == o.arc_mode && alpha == o.alpha;
+			}
+			bool operator!=(const Style& o) const {
+				return !(*this == o);
+			}
 		};
 	}
 	
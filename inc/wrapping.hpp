@@ -92,6 +92,16 @@ inline uint cpp<uint>(Var v) {
 	return v->IntegerValue();
 }
 
+template<>
+inline double cpp<double>(Var v) {
+	#ifdef DEBUG
+		if(!v->IsNumber()) {
+			throw std::logic_error("cpp<double> got " + js_typeof(v));
+		}
+	#endif
+	return v->NumberValue();
+}
+
 template<>
 inline string cpp<string>(Var v) {
 	#ifdef DEBUG
@@ -113,6 +123,25 @@ inline Local<Object> cpp<Object>(Var v) {
 	return v->ToObject();
 }
 
+/**
+ * Get the backing store of a typed array without copying it, with
+ *  len set to the number of T it holds.
+**/
+template<typename T>
+inline T* typed_array(Var v, size_t& len) {
+	#ifdef DEBUG
+		if(!v->IsArrayBufferView()) {
+			throw std::logic_error("typed_array got " + js_typeof(v));
+		}
+	#endif
+	
+	auto view = Local<ArrayBufferView>::Cast(v);
+	auto* data = (char*)view->Buffer()->GetContents().Data();
+	
+	len = view->ByteLength()/sizeof(T);
+	return (T*)(data + view->ByteOffset());
+}
+
 #define JS(v) js(isolate, v)
 
 inline Local<Boolean> js(Isolate* isolate, bool v) {
@@ -127,6 +156,10 @@ inline Local<Integer> js(Isolate* isolate, uint v) {
 	return Integer::New(isolate, v);
 }
 
+inline Local<Number> js(Isolate* isolate, double v) {
+	return Number::New(isolate, v);
+}
+
 inline Local<String> js(Isolate* isolate, const char* v) {
 	return String::NewFromUtf8(isolate, v);
 }
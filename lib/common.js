@@ -14,6 +14,29 @@ class Size {
 	}
 }
 
+class View {
+	constructor(left, right, top, bottom) {
+		this.left = left;
+		this.right = right;
+		this.top = top;
+		this.bottom = bottom;
+	}
+	
+	get width() {
+		return this.right - this.left;
+	}
+	set width(x) {
+		this.right = this.left + x;
+	}
+	
+	get height() {
+		return this.bottom - this.top;
+	}
+	set height(x) {
+		this.bottom = this.top + x;
+	}
+}
+
 /**
  * For API convenience, define method aliases.
 **/
@@ -22,7 +45,7 @@ function alias(klass, to_alias) {
 	for(let name in to_alias) {
 		let real = proto[name];
 		
-		for(let alias in to_alias[name]) {
+		for(let alias of to_alias[name]) {
 			proto[alias] = real;
 		}
 	}
@@ -41,5 +64,5 @@ function definePrivate(self, name, value) {
 }
 
 module.exports = {
-	Position, Size, alias, flatten, private: definePrivate
+	Position, Size, View, alias, flatten, private: definePrivate
 };
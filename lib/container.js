@@ -1,36 +1,51 @@
 'use strict';
 
 const
-	{Frame} = require("./frame"),
-	common = require("./common");
+	{Frame, beforeFlush} = require("./frame"),
+	{Widget} = require("./widget"),
+	{native} = require("./native"),
+	common = require("./common"),
+	{View} = common;
 
-class View {
-	constructor(left, right, top, bottom) {
-		this.left = left;
-		this.right = right;
-		this.top = top;
-		this.bottom = bottom;
-	}
-	
-	get width() {
-		return this.right - this.left;
-	}
-	set width(x) {
-		this.right = this.left + x;
+// Containers changed since the last layout pass
+const changed = new Set();
+
+/**
+ * Lay out every tree with a changed container in it, once each.
+**/
+function layoutChanged() {
+	let tops = new Set();
+	for(let c of changed) {
+		tops.add(c.outermost);
 	}
+	changed.clear();
 	
-	get height() {
-		return this.bottom - this.top;
-	}
-	set height(x) {
-		this.bottom = this.top + x;
+	for(let top of tops) {
+		top.layoutTree();
 	}
 }
 
 /**
- * A policy for ordering container children.
+ * A policy for ordering container children. The built in orders are
+ *  carried out natively by the view tree, which only redoes what a
+ *  change could affect. Others can implement order() instead.
 **/
 class Order {
+	/**
+	 * Which native order this is, or NONE if order() places the
+	 *  children.
+	**/
+	get kind() {
+		return Order.NONE;
+	}
+	
+	/**
+	 * Set the order of a view tree node to this.
+	**/
+	apply(id) {
+		native.viewSetOrder(id, this.kind);
+	}
+	
 	/**
 	 * Iterate over the children of the container, yielding the
 	 *  display rectangle to use relative to the container.
@@ -46,6 +61,14 @@ class Order {
 // Allow accessing common order implementations by name
 Order.registry = {};
 
+// Native orders, as in viewtree.cc
+Order.NONE = 0;
+Order.STACK = 1;
+Order.ROW = 2;
+Order.COLUMN = 3;
+Order.FLOW = 4;
+Order.GRID = 5;
+
 function selectOrder(order) {
 	if(typeof order === 'string') {
 		return new (Order.registry[order] || Order.registry.default);
@@ -60,14 +83,8 @@ function selectOrder(order) {
     effectively telling children to draw on top of each other.
 **/
 class StackOrder extends Order {
-	*order(container) {
-		let
-			{w, h} = container.getDisplaySize(),
-			padding = container.getPadding();
-		
-		for(let c of container) {
-			yield new View(padding.left, padding.top, w, h);
-		}
+	get kind() {
+		return Order.STACK;
 	}
 }
 Order.register('stack', StackOrder);
@@ -76,19 +93,8 @@ Order.register('stack', StackOrder);
  * Arrange the children into equal rows.
 **/
 class RowOrder extends Order {
-	*order(container) {
-		let
-			{w, h} = container.getDisplaySize(),
-			padding = container.getPadding(),
-			x = padding.left;
-		
-Pr
-		w /= container.children.length;
-		
-		for(let c of container) {
-			yield new View(x, padding.top, w, h);
-			x += h;
-		}
+	get kind() {
+		return Order.ROW;
 	}
 }
 Order.register('row', RowOrder);
@@ -98,18 +104,8 @@ Order.register('default', RowOrder);
  * Arrange the children into equal columns.
 **/
 class ColumnOrder extends Order {
-	*order(container) {
-		let
-			{w, h} = container.getDisplaySize(),
-			padding = container.getPadding(),
-			y = padding.top;
-		
-		h /= container.children.length;
-		
-		for(let c of container) {
-			yield new View(padding.left, y, w, h);
-			y += h;
-		}
+	get kind() {
+		return Order.COLUMN;
 	}
 }
 Order.register('column', ColumnOrder);
@@ -120,60 +116,95 @@ Order.register('column', ColumnOrder);
  *  that line has only one element).
 **/
 class FlowOrder extends Order {
-	*order(container) {
-		let
-			size = container.getDisplaySize(),
-			padding = container.getPadding(),
-			x = padding.left, y = padding.top,
-			lineheight = 0;
-		
-		for(let c of container) {
-			yield new Position(x, y);
-			
-			// Defer to the child if it has special wrapping support
-			if(typeof c[FlowOrder.wrap] === 'function') {
-				({x, y, lineheight} = c[FlowOrder.wrap](
-					x, y, lineheight, size
-				));
-			}
-			else {
-				let
-					{w, h} = c.getLogicalSize(size),
-					margin = c.getMargin(),
-					ww = margin.left + w + margin.right;
-				
-				if(x + ww > size.w - padding.right) {
-					x = padding.left;
-					y += lineheight;
-					lineheight = 0;
-				}
-				else {
-					x += ww;
-					lineheight = Math.max(lineheight, h);
-				}
-			}
-		}
+	get kind() {
+		return Order.FLOW;
 	}
 }
-FlowOrder.wrap = Symbol("FlowOrder.wrap");
 Order.register('flow', FlowOrder);
 
+/**
+ * Arrange the children in a grid of columns and rows. Each track is a
+ *  number of pixels, "auto" to fit what's in it, or "<n>fr" for n shares
+ *  of the space left over. Children go in the cell their layout names,
+ *  spanning as many tracks as it says, or else fill the columns row by
+ *  row. Rows past those given fit their content.
+**/
+class GridOrder extends Order {
+	constructor(config={}) {
+		super();
+		
+		this.columns = config.columns || ["1fr"];
+		this.rows = config.rows || [];
+	}
+	
+	get kind() {
+		return Order.GRID;
+	}
+	
+	apply(id) {
+		super.apply(id);
+		native.viewSetGrid(
+			id, this.columns.length,
+			...common.flatten(this.columns.map(track)),
+			...common.flatten(this.rows.map(track))
+		);
+	}
+}
+Order.register('grid', GridOrder);
+
+/**
+ * Leave the children where their own geometry puts them.
+**/
+class FreeOrder extends Order {
+	*order(container) {}
+}
+Order.register('none', FreeOrder);
+
+// Track kinds, as in viewtree.cc
+const AUTO = 0, FIXED = 1, FRACTION = 2;
+
+/**
+ * Kind and value of a grid track, with fractions in thousandths.
+**/
+function track(t) {
+	if(typeof t === 'number') {
+		return [FIXED, Math.max(0, t|0)];
+	}
+	
+	let fr = /^\s*([\d.]+)\s*fr\s*$/.exec(t);
+	if(fr) {
+		return [FRACTION, Math.round(parseFloat(fr[1])*1000)];
+	}
+	
+	return [AUTO, 0];
+}
+
 class Container extends Frame {
 	constructor(config={}, children=[]) {
 		super(config);
 		
+		this.children = [];
 		this.order = selectOrder(config.order || "default");
-		this.children = children;
+		this.order.apply(this.viewRoot);
 		
-		this._order_cache = [];
+		// The outermost container lays out everything in it
+		this.on('resize', () => {
+			if(!(this.parent instanceof Container)) {
+				this.reflow();
+			}
+		});
 		
-		for(let c of children) {
-			c._reparent(this);
-		}
+		this.appendChildren(...children);
 	}
 	
 	[Symbol.iterator]() {
-		return this.order[Symbol.iterator]();
+		return this.children[Symbol.iterator]();
+	}
+	
+	setOrder(order) {
+		this.order = selectOrder(order);
+		this.order.apply(this.viewRoot);
+		return this.reflow();
 	}
 	
 	/**
@@ -183,26 +214,30 @@ class Container extends Frame {
 	 *  be inlined.
 	**/
 	_spliceChildren(x, del, children) {
-		Array.splice.call(this.children, x, del, ...children);
+		this.children.splice(x, del, ...children);
 		return this;
 	}
 	
 	spliceChildren(x, del, ...children) {
 		children = common.flatten(children);
 		
-		for(let c of children) {
-			c._reparent(this);
+		let
+			removed = this.children.slice(x, x + del),
+			next = this.children[x + del];
+		
+		for(let c of removed) {
+			native.viewDetach(c.viewRoot);
+			c.reparent(null);
 		}
-		for(let i = x, n = 0; i < children.length; ++i) {
-			if(n++ < del) {
-				this.children[i]._reparent(null);
-			}
-			else {
-				break;
-			}
+		for(let c of children) {
+			native.viewInsert(
+				this.viewRoot, c.viewRoot, next? next.viewRoot : 0
+			);
+			c.reparent(this);
 		}
 		
-		return this._spliceChildren(x, del, children);
+		this._spliceChildren(x, del, children);
+		return this.reflow();
 	}
 	
 	/**
@@ -215,7 +250,7 @@ class Container extends Frame {
 	 * @hasAlias appendChild
 	**/
 	appendChildren(...children) {
-		return this.spliceChildren(this.length, 0, ...children);
+		return this.spliceChildren(this.children.length, 0, ...children);
 	}
 	
 	/**
@@ -242,41 +277,33 @@ class Container extends Frame {
 	 * Remove the given children.
 	**/
 	removeChildren(...children) {
-		for(let c of child) {
+		for(let c of children) {
 			let x = this.children.indexOf(c);
 			if(x !== -1) {
-				this._spliceChildren(x, 1, []);
+				this.spliceChildren(x, 1);
 			}
 		}
 		return this;
 	}
 	
 	/**
-	 * Get the position of a child wrt an ancestor node, or null if
-	 *  inapplicable.
+	 * Get the position of a child wrt an ancestor node, or the
+	 *  outermost one if not given. Null if inapplicable.
 	**/
 	getPositionOf(child, wrt=null) {
-		let cx = this.children.indexOf(child);
-		if(cx === -1) {
+		if(this.children.indexOf(child) === -1 || !child.view) {
 			return null;
 		}
 		
-		let pos = this._order_cache[cx];
-		//zpos.x += layout.
-		let order = this.order.order(this);
-		for(let i = 0; i < cx; ++i) {
-			let pos = order.next();
-		}
-		
-		if(wrt === this) {
-			return pos;
-		}
-		else if(this.parent) {
-			return this.parent.getPositionOf(child, wrt);
-		}
-		else {
-			return null;
+		let pos = new common.Position(child.view.left, child.view.top);
+		for(let p = this; p !== wrt; p = p.parent) {
+			if(!p || !p.view) {
+				return wrt? null : pos;
+			}
+			pos.x += p.view.left;
+			pos.y += p.view.top;
 		}
+		return pos;
 	}
 	
 	getLogicalView(dsize) {
@@ -285,41 +312,110 @@ class Container extends Frame {
 		
 		let left = Infinity, right = 0, top = Infinity, bottom = 0;
 		
-		for(let c of this._order_cache) {
-			left = Math.min(c.x, left);
-			right = Math.max(c.x + c.width, right);
-			top = Math.min(c.y, top);
-			bottom = Math.max(c.y + c.height, bottom);
+		for(let c of this.children) {
+			let v = c.view;
+			if(v) {
+				left = Math.min(v.left, left);
+				right = Math.max(v.right, right);
+				top = Math.min(v.top, top);
+				bottom = Math.max(v.bottom, bottom);
+			}
 		}
 		
 		return new View(left, right, top, bottom);
 	}
 	
 	/**
-	 * Update the order cache in response to a change in the layout.
+	 * Update the layout in response to a change. Changes only mark the
+	 *  tree, and it's laid out once before the next draw or flush from
+	 *  the outermost container, recomputing only what they could
+	 *  affect.
 	**/
 	reflow() {
-		this._order_cache = Array.from(this.order.order(this));
-		this.emit('reflow');
-		if(this.parent) {
-			this.parent.reflow();
+		if(!changed.size) {
+			beforeFlush(layoutChanged);
+		}
+		changed.add(this);
+		return this;
+	}
+	
+	get outermost() {
+		let top = this;
+		while(top.parent instanceof Container) {
+			top = top.parent;
 		}
+		return top;
+	}
+	
+	/**
+	 * Lay out everything under this container at its current size,
+	 *  moving whatever frames and widgets changed place. This is done
+	 *  for reflow() before the next flush, but can be called to get the
+	 *  layout right away.
+	**/
+	layoutTree() {
+		let {w, h} = this.getDisplaySize(), moved;
+		this.orderChildren();
 		
+		// Orders done in JS place their children as they're placed, so
+		//  go again until nothing moves
+		while((moved = native.viewLayout(this.viewRoot, w, h)).length) {
+			for(let i = 0; i < moved.length; i += 5) {
+				let
+					id = moved[i],
+					node = Widget.fromView(id) || Frame.fromView(id);
+				
+				if(node) {
+					node.place(
+						moved[i + 1], moved[i + 2], moved[i + 3], moved[i + 4]
+					);
+				}
+			}
+		}
+		
+		this.emit('reflow');
 		return this;
 	}
 	
 	/**
-	 * @override
+	 * Place the children with order() if the order isn't native.
 	**/
-	draw(g) {
-		let
-			pos = this.getPosition(),
-			size = this.getLogicalView();
+	orderChildren() {
+		if(this.order.kind !== Order.NONE) {
+			return this;
+		}
 		
-		for(let c of this.children) {
-			g.drawChild(pos, size, c);
+		let i = 0;
+		for(let v of this.order.order(this)) {
+			let c = this.children[i++];
+			if(!c) {
+				break;
+			}
+			
+			native.viewSetGeometry(
+				c.viewRoot, v.left, v.top, v.width, v.height
+			);
+			c.place(v.left, v.top, v.width, v.height);
 		}
+		return this;
+	}
+	
+	/**
+	 * @override
+	**/
+	place(x, y, w, h) {
+		super.place(x, y, w, h);
+		return this.orderChildren();
 	}
+	
+	/**
+	 * Children are frames with windows of their own, which the server
+	 *  paints and sends their own draw events for, so there's nothing
+	 *  of theirs to draw here.
+	 *
+	 * @override
+	**/
+	draw(g, damage=null) {}
 }
 common.alias(Container, {
 	appendChildren: [
@@ -332,6 +428,6 @@ common.alias(Container, {
 
 module.exports = {
 	View,
-	Order, StackOrder, RowOrder, ColumnOrder, FlowOrder,
-	Container
+	Order, StackOrder, RowOrder, ColumnOrder, FlowOrder, GridOrder,
+	FreeOrder, Container
 };
@@ -1,11 +1,14 @@
 'use strict';
 
+const {native} = require("./native");
+
 const CODES = {
 	unknown: 0,
 	mousemove: 1, scroll: 2, click: 3, hover: 4,
 	keypress: 5,
 	move: 6, resize: 7, focus: 8,
-	draw: 9
+	draw: 9, open: 10, close: 11,
+	error: 12
 };
 
 function isInputEvent(ev) {
@@ -18,7 +21,7 @@ Event.prototype.name = 'event';
 class UnknownEvent extends Event {
 	constructor(ev) {
 		super();
-		this.raw = ev;
+		this.raw = Object.assign({}, ev);
 	}
 }
 UnknownEvent.prototype.name = 'unknown';
@@ -39,6 +42,8 @@ class ScrollEvent extends Event {
 		super();
 		
 		this.delta = ev.delta;
+		this.x = ev.x;
+		this.y = ev.y;
 	}
 }
 ScrollEvent.prototype.name = 'scroll';
@@ -52,6 +57,8 @@ class ClickEvent extends Event {
 		this.button = MOUSE_NAMES[ev.button];
 		this.state = ev.state;
 		this.dragging = ev.dragging;
+		this.x = ev.x;
+		this.y = ev.y;
 	}
 }
 ClickEvent.prototype.name = 'click';
@@ -210,25 +217,149 @@ class FocusEvent extends Event {
 }
 FocusEvent.prototype.name = 'focus';
 
+/**
+ * Exposures are merged natively, so one draw event covers the
+ *  bounding box of everything damaged since the last one.
+**/
 class DrawEvent extends Event {
 	constructor(ev) {
 		super();
-		this.raw = ev;
+		
+		this.x = ev.x;
+		this.y = ev.y;
+		this.w = ev.w;
+		this.h = ev.h;
 	}
 }
 DrawEvent.prototype.name = "draw";
 
+/**
+ * A request which was sent without waiting for its reply failed.
+**/
+class ErrorEvent extends Event {
+	constructor(ev) {
+		super();
+		
+		this.error = ev.error;
+		this.major = ev.major;
+		this.minor = ev.minor;
+		this.resource = ev.resource;
+		this.sequence = ev.sequence;
+		this.message = native.describeError(
+			ev.error, ev.major, ev.minor, ev.resource, ev.site
+		);
+	}
+}
+ErrorEvent.prototype.name = "error";
+
 const EVENTS = [
 	UnknownEvent, MouseMoveEvent, ScrollEvent, ClickEvent,
 	HoverEvent, KeyPressEvent,
 	WindowMoveEvent, ResizeEvent, FocusEvent,
-	DrawEvent
+	DrawEvent, UnknownEvent, UnknownEvent,
+	ErrorEvent
 ];
 
 function prettify(ev) {
 	return Object.freeze(new (EVENTS[ev.code] || UnknownEvent)(ev));
 }
 
+/**
+ * Number of int32 slots per record filled by native.pollEvents(),
+ *  laid out as [code, target, ...fields].
+**/
+const RECORD_LEN = 8;
+
+// Reused between decodes so the only allocation is the event itself
+const scratch = {};
+
+/**
+ * Build the event stored at offset i of a pollEvents() record buffer.
+**/
+function decode(rec, i) {
+	let ev = scratch;
+	ev.code = rec[i];
+	ev.target = rec[i + 1];
+	
+	switch(ev.code) {
+		case CODES.mousemove:
+			ev.x = rec[i + 2];
+			ev.y = rec[i + 3];
+			ev.dragging = !!rec[i + 4];
+			break;
+		case CODES.scroll:
+			ev.delta = rec[i + 2];
+			ev.x = rec[i + 3];
+			ev.y = rec[i + 4];
+			break;
+		case CODES.click:
+			ev.button = rec[i + 2];
+			ev.state = !!rec[i + 3];
+			ev.dragging = !!rec[i + 4];
+			ev.x = rec[i + 5];
+			ev.y = rec[i + 6];
+			break;
+		case CODES.hover:
+			ev.x = rec[i + 2];
+			ev.y = rec[i + 3];
+			ev.state = !!rec[i + 4];
+			break;
+		
+		case CODES.keypress: {
+			let mods = rec[i + 5];
+			
+			ev.button = rec[i + 2];
+			ev.key = rec[i + 3];
+			ev.state = !!rec[i + 4];
+			ev.shift = !!(mods&1);
+			ev.ctrl = !!(mods&2);
+			ev.alt = !!(mods&4);
+			ev.meta = !!(mods&8);
+			break;
+		}
+		
+		case CODES.move:
+			ev.x = rec[i + 2];
+			ev.y = rec[i + 3];
+			break;
+		case CODES.resize:
+			ev.w = rec[i + 2];
+			ev.h = rec[i + 3];
+			break;
+		case CODES.focus:
+			ev.state = !!rec[i + 2];
+			break;
+		
+		case CODES.draw:
+			ev.x = rec[i + 2];
+			ev.y = rec[i + 3];
+			ev.w = rec[i + 4];
+			ev.h = rec[i + 5];
+			break;
+		
+		case CODES.error:
+			ev.error = rec[i + 2];
+			ev.major = rec[i + 3];
+			ev.minor = rec[i + 4];
+			ev.site = rec[i + 5];
+			// Resource ids and sequences are unsigned
+			ev.resource = rec[i + 6]>>>0;
+			ev.sequence = rec[i + 7]>>>0;
+			break;
+		
+		// Nothing is decoded for these, and UnknownEvent copies every
+		//  field, so it gets only the record's rather than the scratch
+		//  left over from the last event
+		default:
+			return prettify({
+				code: ev.code, target: ev.target,
+				data: Array.from(rec.subarray(i + 2, i + RECORD_LEN))
+			});
+	}
+	
+	return prettify(ev);
+}
+
 module.exports = {
 	CODES, isInputEvent,
 	
@@ -236,7 +367,7 @@ module.exports = {
 	MouseMoveEvent, ScrollEvent, ClickEvent,
 	HoverEvent, KeyPressEvent,
 	WindowMoveEvent, ResizeEvent, FocusEvent,
-	DrawEvent,
+	DrawEvent, ErrorEvent,
 	
-	prettify
+	prettify, RECORD_LEN, decode
 };
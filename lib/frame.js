@@ -1,42 +1,169 @@
 'use strict';
 
 const
-	timers = require("timers"),
 	{EventEmitter} = require("events"),
 	{native, NATIVE, COLORMAP} = require("./native"),
 	common = require("./common"),
 	Color = require("./color"),
+	{Region} = require("./region"),
 	events = require("./events");
 
 const frames = new Map();
-function loop() {
-	// Only continue the event loop if there's frames.
-	//  This will make the program exit if all frames are closed
-	//  and no other events are scheduled in Node
-	if(frames.size === 0) {
-		return;
+
+// Frames by the id of their node in the native view tree
+const viewNodes = new Map();
+
+// Style config a frame paints with, once it answers draw events
+const PAINTS = Symbol("paints");
+
+// Events are drained into this in batches rather than creating an
+//  object per event on the native side
+const RING_SIZE = 256;
+const ring = new Int32Array(RING_SIZE*events.RECORD_LEN);
+
+// Fonts from openFonts whose metrics are still on the way, by id
+const fontLoads = new Map();
+
+/**
+ * Open several fonts in one pipelined batch. The ids can be used right
+ *  away, and loaded resolves with them once every font's metrics have
+ *  arrived. loads has a promise per font, for telling which failed.
+**/
+function openFonts(names) {
+	let ids = native.openFonts(...names.map(String));
+	
+	let loads = ids.map(id => new Promise((resolve, reject) => {
+		fontLoads.set(id, {resolve, reject});
+	}));
+	loop();
+	
+	return {ids, loads, loaded: Promise.all(loads)};
+}
+
+/**
+ * Settle the promises of any fonts whose metrics have come in.
+**/
+function collectFonts() {
+	let font;
+	while(font = native.pollFont()) {
+		let load = fontLoads.get(font.id);
+		fontLoads.delete(font.id);
+		
+		if(font.error) {
+			load.reject(new Error(font.error));
+		}
+		else {
+			load.resolve(font.id);
+		}
+	}
+}
+
+// Work to do once before the next flush, such as a layout pass
+const pending = new Set();
+let flushQueued = false;
+
+/**
+ * Run fn once before anything is next sent to the server, however many
+ *  times it's asked for. Inside event dispatch that's before the next
+ *  draw or the end of the batch, otherwise it's on the next tick.
+**/
+function beforeFlush(fn) {
+	pending.add(fn);
+	if(!flushQueued) {
+		flushQueued = true;
+		setImmediate(flush);
+	}
+}
+
+function runPending() {
+	// What runs can ask for more
+	while(pending.size) {
+		let fns = Array.from(pending);
+		pending.clear();
+		for(let fn of fns) {
+			fn();
+		}
+	}
+}
+
+function flush() {
+	flushQueued = false;
+	runPending();
+	native.globalFlush();
+}
+
+/**
+ * Drain the native event queue and send each event to its frame.
+ *  The native event loop calls this whenever the X connection has
+ *  something for us, or with an error once the connection has failed
+ *  and it's stopped listening.
+**/
+function dispatch(error) {
+	if(error) {
+		listening = false;
+		throw error;
 	}
 	
-	timers.setImmediate(function() {
-		let ev;
-		while(ev = native.pollEvent()) {
-			let pev = events.prettify(ev);
+	let n;
+	do {
+		n = native.pollEvents(ring);
+		
+		for(let i = 0; i < n; ++i) {
+			let
+				off = i*events.RECORD_LEN,
+				pev = events.decode(ring, off),
+				frame = frames.get(ring[off + 1]);
+			
+			// An error nobody listens for would throw out of the batch,
+			//  losing the rest of it, so it's only logged
+			let unheard =
+				pev instanceof events.ErrorEvent &&
+				!(frame && frame.listenerCount('error'));
 			
-			let frame = frames.get(ev.target);
-			if(frame) {
+			if(frame && !unheard) {
+				// Draw with the layout up to date
+				if(pev.name === 'draw') {
+					runPending();
+				}
+				
 				frame.emit(pev.name, pev);
 			}
+			else if(unheard) {
+				console.error(pev.message);
+			}
 			else {
 				console.log("No target for", pev.name);
 				console.log(pev);
 			}
 		}
-		
-		// Flush the event queue
-		native.globalFlush();
-		
+	} while(n === RING_SIZE);
+	
+	if(fontLoads.size) {
+		collectFonts();
 		loop();
-	});
+	}
+	
+	// Lay out whatever the events changed, then flush it all
+	runPending();
+	native.globalFlush();
+}
+
+let listening = false;
+function loop() {
+	// Only keep the connection registered with the event loop while
+	//  there's frames or fonts loading. This will make the program exit
+	//  if all frames are closed and no other events are scheduled in
+	//  Node
+	if(frames.size === 0 && fontLoads.size === 0) {
+		if(listening) {
+			native.unlisten();
+			listening = false;
+		}
+	}
+	else if(!listening) {
+		native.listen(dispatch);
+		listening = true;
+	}
 }
 
 class Edge {
@@ -48,6 +175,25 @@ class Edge {
 	}
 }
 
+/**
+ * Put a view tree node in a grid cell, or let it take the next free one.
+**/
+function setCell(id, cell) {
+	if(cell) {
+		native.viewSetCell(
+			id, cell.col|0, cell.row|0,
+			Math.max(cell.colSpan|0, 1), Math.max(cell.rowSpan|0, 1)
+		);
+	}
+	else {
+		native.viewSetCell(id, 0, 0, 0, 0);
+	}
+}
+
+function edges(e) {
+	return [e.left|0, e.top|0, e.right|0, e.bottom|0];
+}
+
 class Style {
 	constructor(config) {
 		Object.assign(this, {
@@ -84,11 +230,16 @@ class Layout {
 		
 		this.padding = config.padding || new Edge(config);
 		this.margin = config.margin || new Edge(config);
+		
+		// {col, row, colSpan, rowSpan} under a grid, or null to go in
+		//  the next free cell
+		this.cell = config.cell || null;
 	}
 }
 
 /**
- * Manage a local color:id map.
+ * Manage a local color:id map. Allocations are also cached natively
+ *  per colormap, so this only saves crossing into C++.
 **/
 class ColorMap {
 	constructor(target) {
@@ -108,6 +259,25 @@ class ColorMap {
 			return id;
 		}
 	}
+	
+	/**
+	 * Get the ids of several colors at once, allocating whichever are
+	 *  missing in a single pipelined batch.
+	**/
+	getAll(...colors) {
+		let
+			values = colors.map(c => Color(c).value()),
+			missing = values.filter(v => !this.colors.has(v));
+		
+		if(missing.length) {
+			let ids = this.target[NATIVE].allocColors(...missing);
+			for(let i = 0; i < missing.length; ++i) {
+				this.colors.set(missing[i], ids[i]);
+			}
+		}
+		
+		return values.map(v => this.colors.get(v));
+	}
 }
 
 /**
@@ -139,7 +309,10 @@ class Frame extends EventEmitter {
 				layout.width|0, layout.height|0,
 				style.borderWidth|0,
 				
-				bg
+				bg,
+				// Top-level frames can ask for an ARGB visual so the
+				//  compositor blends them with what's behind
+				!!config.translucent
 			)
 		);
 		
@@ -171,17 +344,77 @@ class Frame extends EventEmitter {
 	}
 	addListener(type, listener) {
 		if(type in events.CODES) {
-			this[NATIVE].listenEvent(type|0);
+			this[NATIVE].listenEvent(events.CODES[type]);
 		}
 		return super.addListener(type, listener);
 	}
 	
 	destroy() {
-		this[NATIVE].destroy();
-		frames.delete(this.getID());
+		this.emit('destroy');
+		
+		if(this._viewRoot) {
+			viewNodes.delete(this._viewRoot);
+			native.viewDestroy(this._viewRoot);
+			this._viewRoot = 0;
+		}
+		
+		frames.delete(this.id);
+		this[NATIVE].close();
+		loop();
+		return this;
+	}
+	
+	/**
+	 * The frame's node in the native view tree, which is laid out by its
+	 *  parent's order and which the children and windowless widgets in
+	 *  it hang from. Made the first time it's needed.
+	**/
+	get viewRoot() {
+		if(!this._viewRoot) {
+			let id = this._viewRoot = native.viewCreate(true);
+			viewNodes.set(id, this);
+			this.updateLayout();
+		}
+		return this._viewRoot;
+	}
+	
+	/**
+	 * Tell the view tree about changes to this.layout.
+	**/
+	updateLayout() {
+		let l = this.layout, id = this.viewRoot;
+		
+		native.viewSetGeometry(
+			id, l.offsetX|0, l.offsetY|0, l.width|0, l.height|0
+		);
+		native.viewSetLimits(
+			id, l.minWidth|0, l.minHeight|0, l.maxWidth|0, l.maxHeight|0
+		);
+		native.viewSetEdges(id, ...edges(l.padding), ...edges(l.margin));
+		setCell(id, l.cell);
+		
+		if(this.parent && this.parent.reflow) {
+			this.parent.reflow();
+		}
 		return this;
 	}
 	
+	/**
+	 * Move to where layout put the frame's node.
+	**/
+	place(x, y, w, h) {
+		this.view = new common.View(x, x + w, y, y + h);
+		this.setPosition(x, y);
+		// Windows can't be empty
+		this.setSize(Math.max(w, 1), Math.max(h, 1));
+		this.emit('place', this.view);
+		return this;
+	}
+	
+	static fromView(id) {
+		return viewNodes.get(id) || null;
+	}
+	
 	get id() {
 		return this[NATIVE].getID();
 	}
@@ -209,10 +442,10 @@ class Frame extends EventEmitter {
 	}
 	setPosition(x, y) {
 		if(typeof x === 'number') {
-			this[NATIVE].setPosition((x<<16)|y);
+			this[NATIVE].setPosition((x<<16)|(y&0xffff));
 		}
 		else {
-			this[NATIVE].setPosition((x.x<<16)|x.y);
+			this[NATIVE].setPosition((x.x<<16)|(x.y&0xffff));
 		}
 	}
 	
@@ -225,9 +458,98 @@ class Frame extends EventEmitter {
 		this[NATIVE].redraw();
 	}
 	
+	/**
+	 * Redraw only the given area. Whatever is drawn in response is
+	 *  clipped to it, along with anything else exposed meanwhile.
+	**/
+	damage(x, y, w, h) {
+		this[NATIVE].redrawArea(x|0, y|0, Math.max(0, w|0), Math.max(0, h|0));
+		return this;
+	}
+	
+	/**
+	 * Everything exposed or damaged since the last call, as a Region.
+	 *  The frame is left with no damage.
+	**/
+	takeDamage() {
+		let damage = new Region();
+		this[NATIVE].takeDamage(damage[NATIVE]);
+		return damage;
+	}
+	
+	/**
+	 * Answer draw events with paint(). The config gives the starting
+	 *  style of the canvas painted with, and replaces any given before.
+	**/
+	paintOnDraw(config) {
+		if(!this[PAINTS]) {
+			this.on('draw', () => this.paint(this[PAINTS]));
+		}
+		if(config || !this[PAINTS]) {
+			this[PAINTS] = config || {};
+		}
+		return this;
+	}
+	
+	/**
+	 * Repaint the damage, first with draw() and then with anything
+	 *  listening for 'paint', which is given the canvas and the damage.
+	 *  That's how hosted widgets get painted into any frame.
+	**/
+	paint(config={}) {
+		// Only what was damaged is repainted, anything else drawn
+		//  is clipped away by the server
+		let damage = this.takeDamage();
+		if(damage.empty) {
+			return this;
+		}
+		
+		// Windowless widgets are painted by moving the origin
+		let g = new Frame.Canvas(
+			this, Object.assign({}, config, {x: 0, y: 0})
+		);
+		
+		// A numeric visibility is the opacity everything is drawn at
+		if(typeof this.style.visibility === 'number') {
+			g.setStyle({opacity: this.style.visibility});
+		}
+		g.setClip(damage);
+		
+		// A retained drawing is replayed for later exposures anywhere
+		//  in the frame, so it has to have everything in it
+		let cull = this.retain? null : damage;
+		
+		g.record();
+		this.draw(g, cull);
+		this.emit('paint', g, cull);
+		g.submit(!!this.retain);
+		
+		g.setClip(null);
+		return this;
+	}
+	
+	/**
+	 * Draw into a back buffer which is copied to the window when a
+	 *  draw is submitted. Exposures are then answered from the buffer
+	 *  without another draw, and redraws don't flicker.
+	**/
+	setBuffered(buffered) {
+		this[NATIVE].setBuffered(!!buffered);
+		return this;
+	}
+	
+	/**
+	 * Copy what's been drawn to the back buffer to the window. Done
+	 *  automatically when a GraphicsContext submits.
+	**/
+	present() {
+		this[NATIVE].present();
+		return this;
+	}
+	
 	getSize() {
 		let s = this[NATIVE].getSize();
-		return new Size(s>>16, s&0xffff);
+		return new common.Size(s>>>16, s&0xffff);
 	}
 	setSize(x, y) {
 		if(typeof x === 'number') {
@@ -395,7 +717,7 @@ class Frame extends EventEmitter {
 	 *  displayed.
 	**/
 	getDisplaySize() {
-		return new NotImplemented(this, Widget, 'getDisplaySize');
+		return this.getSize();
 	}
 	
 	/**
@@ -406,16 +728,19 @@ class Frame extends EventEmitter {
 	}
 	
 	/**
-	 * Draw the widget using the given graphics context.
+	 * Draw the frame's own content when it's painted. Nothing by
+	 *  default, though hosted widgets are still painted over it.
 	**/
-	draw(g) {
-		throw new NotImplemented(this, Widget, 'draw');
-	}
+	draw(g, damage=null) {}
 	
 	/*** END: abstract methods ***/
 }
 Frame.registry = {};
 
+// The Canvas class paint() draws with, set by window.js since it can't
+//  be required here without a cycle
+Frame.Canvas = null;
+
 module.exports = {
-	Frame
+	Frame, openFonts, beforeFlush, setCell
 };
@@ -0,0 +1,71 @@
+'use strict';
+
+const {native, NATIVE, defineNative} = require("./native");
+
+/**
+ * Pixels in the screen's own format, uploaded through shared memory
+ *  when the server is on this machine. ARGB images keep their alpha and
+ *  are blended onto whatever they're drawn to.
+**/
+class Image {
+	constructor(width, height, argb=false) {
+		this.width = width|0;
+		this.height = height|0;
+		this.argb = !!argb;
+		
+		defineNative(this, new native.NativeImage(
+			this.width, this.height, this.argb
+		));
+		
+		this.stride = this[NATIVE].getStride();
+		this.depth = this[NATIVE].getDepth();
+		
+		// Writes go straight to the memory the server reads from
+		this.data = this[NATIVE].getData();
+	}
+	
+	get shared() {
+		return this[NATIVE].isShared();
+	}
+	
+	/**
+	 * Whether the server might still be reading the last put, in which
+	 *  case writing to data could tear it.
+	**/
+	get busy() {
+		return this[NATIVE].isBusy();
+	}
+	
+	/**
+	 * Fill the image from a Uint32Array of RGBA words, as packed by
+	 *  Color.value(), converting to the screen's format natively.
+	**/
+	writePixels(rgba) {
+		this[NATIVE].writePixels(rgba);
+		return this;
+	}
+	
+	/**
+	 * Wait for the server to finish reading the pixels.
+	**/
+	sync() {
+		this[NATIVE].sync();
+		return this;
+	}
+	
+	/**
+	 * Release the pixels. data can't be used after this.
+	**/
+	destroy() {
+		this[NATIVE].destroy();
+		this.data = null;
+	}
+}
+
+// Conversions and kernels for native.convertPixels
+Image.CONVERSIONS = {xrgb: 0, argbPremul: 1};
+Image.KERNELS = {auto: 0, scalar: 1, sse2: 2, avx2: 3};
+
+module.exports = {
+	Image
+};
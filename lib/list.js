@@ -0,0 +1,217 @@
+'use strict';
+
+const
+	{Window} = require("./window"),
+	{Widget} = require("./widget"),
+	{beforeFlush} = require("./frame"),
+	{native} = require("./native"),
+	common = require("./common");
+
+// The native index of row offsets
+const INDEX = Symbol("index");
+
+// Bound update, so asking for it repeatedly before a flush runs it once
+const UPDATE = Symbol("update");
+
+/**
+ * A scrolling list of count rows, of which only those in view and a few
+ *  either side exist as widgets. Rows scrolled out are hidden and reused
+ *  for those scrolled in, so what it costs follows the height of the
+ *  window rather than the length of the list.
+ *
+ * Row heights are rowHeight, either a number or a function of the row
+ *  index. The function is only asked about rows as they come into view,
+ *  anything not yet seen is estimatedRowHeight tall. createRow makes an
+ *  empty row widget and updateRow(row, i) fills one in for row i.
+**/
+class List extends Window {
+	constructor(config={}) {
+		super(Object.assign({}, config, {order: "none"}));
+		
+		let
+			fixed = typeof config.rowHeight === 'number',
+			estimate = fixed?
+				config.rowHeight : config.estimatedRowHeight || 20;
+		
+		this.rowHeight = fixed? null : config.rowHeight || null;
+		this.overscan = config.overscan === undefined?
+			4 : Math.max(0, config.overscan|0);
+		this.scrollStep = config.scrollStep || 3*estimate;
+		this.createRow = config.createRow || (() => new Widget());
+		this.updateRow = config.updateRow || (() => {});
+		
+		this.scrollTop = 0;
+		
+		// Bound rows by index, and released ones waiting to be reused
+		this.rows = new Map();
+		this.pool = [];
+		
+		common.private(
+			this, INDEX, new native.NativeRowIndex(config.count|0, estimate)
+		);
+		common.private(this, UPDATE, () => this.update());
+		
+		this.on('scroll', ev => this.scrollBy(ev.delta*this.scrollStep));
+		this.on('resize', () => beforeFlush(this[UPDATE]));
+		
+		beforeFlush(this[UPDATE]);
+	}
+	
+	get count() {
+		return this[INDEX].getCount();
+	}
+	
+	/**
+	 * Height of everything in the list, with unseen rows estimated.
+	**/
+	get scrollHeight() {
+		return this[INDEX].total();
+	}
+	
+	setCount(n) {
+		this[INDEX].setCount(Math.max(0, n|0));
+		return this.scrollTo(this.scrollTop);
+	}
+	
+	/**
+	 * Scroll so y is at the top, as far as the rows go.
+	**/
+	scrollTo(y) {
+		let max = this.scrollHeight - this.getDisplaySize().h;
+		this.scrollTop = Math.max(0, Math.min(Math.round(y), max));
+		beforeFlush(this[UPDATE]);
+		return this;
+	}
+	scrollBy(dy) {
+		return this.scrollTo(this.scrollTop + dy);
+	}
+	scrollToRow(i) {
+		return this.scrollTo(this[INDEX].offset(Math.max(0, i|0)));
+	}
+	
+	/**
+	 * The row at y from the top of the list.
+	**/
+	rowAt(y) {
+		return this[INDEX].find(y);
+	}
+	
+	/**
+	 * Fill the rows in again, for when what they show has changed.
+	**/
+	refresh() {
+		for(let i of this.rows.keys()) {
+			this.release(i);
+		}
+		beforeFlush(this[UPDATE]);
+		return this;
+	}
+	
+	/**
+	 * Bind the rows in view to widgets and put them in place. This is
+	 *  done before the next flush after scrolling or resizing, but can
+	 *  be called to do it right away.
+	**/
+	update() {
+		let
+			index = this[INDEX],
+			{w, h} = this.getDisplaySize(),
+			count = index.getCount();
+		
+		// Measuring the rows above the top moves it, so keep the row at
+		//  the top where it is
+		let
+			top = index.find(this.scrollTop),
+			into = this.scrollTop - index.offset(top),
+			first = Math.max(0, top - this.overscan);
+		
+		for(let i = first; i < top; ++i) {
+			this.measure(i);
+		}
+		
+		let max = index.total() - h;
+		this.scrollTop = Math.max(0, Math.min(index.offset(top) + into, max));
+		
+		// Clamping to the end can move the top up past what was measured
+		let i = index.find(this.scrollTop), end = this.scrollTop + h;
+		for(let j = Math.max(0, i - this.overscan); j < first; ++j) {
+			this.measure(j);
+		}
+		first = Math.min(first, Math.max(0, i - this.overscan));
+		while(i < count && index.offset(i) < end) {
+			this.measure(i++);
+		}
+		
+		let last = Math.min(count, i + this.overscan);
+		for(; i < last; ++i) {
+			this.measure(i);
+		}
+		
+		for(let i of this.rows.keys()) {
+			if(i < first || i >= last) {
+				this.release(i);
+			}
+		}
+		
+		for(let i = first; i < last; ++i) {
+			let
+				row = this.bind(i),
+				y = index.offset(i) - this.scrollTop,
+				b = row.bounds, rh = index.height(i);
+			
+			if(b.x || b.y !== y || b.w !== w || b.h !== rh) {
+				row.setGeometry(0, y, w, rh);
+			}
+		}
+		
+		this.emit('update', {first, last});
+		return this;
+	}
+	
+	/**
+	 * Ask the height of a row not yet bound.
+	**/
+	measure(i) {
+		if(this.rowHeight && !this.rows.has(i)) {
+			this[INDEX].setHeight(i, this.rowHeight(i)|0);
+		}
+	}
+	
+	/**
+	 * The widget showing row i, taking one from the pool if it isn't
+	 *  bound yet.
+	**/
+	bind(i) {
+		let row = this.rows.get(i);
+		if(row) {
+			return row;
+		}
+		
+		row = this.pool.pop();
+		if(!row) {
+			row = this.createRow();
+			row.addTo(this);
+		}
+		
+		this.updateRow(row, i);
+		row.show();
+		this.rows.set(i, row);
+		return row;
+	}
+	
+	/**
+	 * Hide the widget showing row i and keep it for reuse.
+	**/
+	release(i) {
+		let row = this.rows.get(i);
+		if(row) {
+			this.rows.delete(i);
+			row.hide();
+			this.pool.push(row);
+		}
+	}
+}
+
+module.exports = {
+	List
+};
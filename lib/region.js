@@ -0,0 +1,86 @@
+'use strict';
+
+const {native, NATIVE, defineNative} = require("./native");
+
+/**
+ * A set of pixels kept natively as banded rectangles, used for the
+ *  damage a draw has to repaint and for clipping.
+**/
+class Region {
+	constructor(x, y, w, h) {
+		defineNative(this, new native.NativeRegion());
+		
+		if(typeof x === 'number') {
+			this.union(x, y, w, h);
+		}
+	}
+	
+	/**
+	 * Each op takes another region or x, y, w, h.
+	**/
+	union(x, y, w, h) {
+		op(this, 'unite', x, y, w, h);
+		return this;
+	}
+	intersect(x, y, w, h) {
+		op(this, 'intersect', x, y, w, h);
+		return this;
+	}
+	subtract(x, y, w, h) {
+		op(this, 'subtract', x, y, w, h);
+		return this;
+	}
+	
+	translate(dx, dy) {
+		this[NATIVE].translate(dx|0, dy|0);
+		return this;
+	}
+	
+	clear() {
+		this[NATIVE].clear();
+		return this;
+	}
+	
+	get empty() {
+		return this[NATIVE].isEmpty();
+	}
+	
+	/**
+	 * Whether any of the rectangle is in the region.
+	**/
+	intersects(x, y, w, h) {
+		return this[NATIVE].intersects(
+			x|0, y|0, Math.max(0, w|0), Math.max(0, h|0)
+		);
+	}
+	
+	/**
+	 * {x, y, w, h} of the smallest rectangle containing the region.
+	**/
+	get extents() {
+		return this[NATIVE].getExtents();
+	}
+	
+	/**
+	 * Int32Array of x, y, w, h for each rectangle, top to bottom then
+	 *  left to right.
+	**/
+	get rects() {
+		return this[NATIVE].getRects();
+	}
+}
+
+function op(region, name, x, y, w, h) {
+	if(x instanceof Region) {
+		region[NATIVE][name](x[NATIVE]);
+	}
+	else {
+		region[NATIVE][name](
+			x|0, y|0, Math.max(0, w|0), Math.max(0, h|0)
+		);
+	}
+}
+
+module.exports = {
+	Region
+};
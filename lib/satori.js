@@ -11,10 +11,14 @@ const
 	} = require("./events"),
 	{Frame} = require("./frame"),
 	{Window, GraphicsContext, Canvas} = require("./window"),
+	{Image} = require("./image"),
+	{Region} = require("./region"),
+	{Widget} = require("./widget"),
 	{
-		Order, StackOrder, RowOrder, ColumnOrder, FlowOrder,
-		Container
-	} = require("./container")
+		Order, StackOrder, RowOrder, ColumnOrder, FlowOrder, GridOrder,
+		FreeOrder, Container
+	} = require("./container"),
+	{List} = require("./list");
 
 module.exports = {
 	Color,
@@ -27,8 +31,9 @@ module.exports = {
 	
 	Frame,
 	Window, GraphicsContext,
+	Image, Region, Widget,
 	
-	Order, StackOrder, RowOrder, ColumnOrder, FlowOrder,
-	Container
+	Order, StackOrder, RowOrder, ColumnOrder, FlowOrder, GridOrder,
+	FreeOrder, Container, List
 };
 
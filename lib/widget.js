@@ -0,0 +1,305 @@
+'use strict';
+
+const
+	{EventEmitter} = require("events"),
+	{native, NATIVE} = require("./native"),
+	{setCell} = require("./frame");
+
+// Every live widget by view node id, for hit testing and painting
+const widgets = new Map();
+
+// Input events routed to the widget under the pointer
+const ROUTED = ['click', 'scroll', 'mousemove'];
+
+// Set of the widgets directly under a frame, once it hosts any
+const HOSTED = Symbol("hosted");
+
+/**
+ * A widget without an X window. It lives only in the native view tree
+ *  and is painted into the drawable of the nearest frame above it, which
+ *  also hit tests input for it. Thousands of these cost memory, not
+ *  server resources.
+**/
+class Widget extends EventEmitter {
+	constructor(config={}) {
+		super();
+		
+		this.id = native.viewCreate();
+		this.parent = null;
+		this.children = [];
+		this.visible = true;
+		
+		this.bounds = {x: 0, y: 0, w: 0, h: 0};
+		this.setGeometry(
+			config.x|0, config.y|0,
+			(config.w || config.width)|0, (config.h || config.height)|0
+		);
+		
+		widgets.set(this.id, this);
+	}
+	
+	get x() {
+		return this.bounds.x;
+	}
+	get y() {
+		return this.bounds.y;
+	}
+	get width() {
+		return this.bounds.w;
+	}
+	get height() {
+		return this.bounds.h;
+	}
+	
+	/**
+	 * Move and resize, relative to the parent. The old and new areas
+	 *  are both repainted.
+	**/
+	setGeometry(x, y, w, h) {
+		this.damage();
+		
+		let b = this.bounds = {
+			x: x|0, y: y|0, w: Math.max(0, w|0), h: Math.max(0, h|0)
+		};
+		native.viewSetGeometry(this.id, b.x, b.y, b.w, b.h);
+		
+		this.damage();
+		return this;
+	}
+	/**
+	 * Move to where layout put the widget's node, without changing what
+	 *  it asked for.
+	**/
+	place(x, y, w, h) {
+		this.damage();
+		this.bounds = {x, y, w, h};
+		this.damage();
+		this.emit('place', this.bounds);
+		return this;
+	}
+	setPosition(x, y) {
+		return this.setGeometry(x, y, this.bounds.w, this.bounds.h);
+	}
+	setSize(w, h) {
+		return this.setGeometry(this.bounds.x, this.bounds.y, w, h);
+	}
+	
+	/**
+	 * Put the widget in a grid cell, {col, row, colSpan, rowSpan}, or
+	 *  null to let it take the next free one.
+	**/
+	setCell(cell) {
+		setCell(this.id, cell);
+		return this;
+	}
+	
+	setVisible(v) {
+		v = !!v;
+		if(v !== this.visible) {
+			this.damage();
+			this.visible = v;
+			native.viewSetVisible(this.id, v);
+			this.damage();
+		}
+		return this;
+	}
+	show() {
+		return this.setVisible(true);
+	}
+	hide() {
+		return this.setVisible(false);
+	}
+	
+	/**
+	 * The frame this is painted into, or null if it isn't in a tree
+	 *  with one.
+	**/
+	get host() {
+		let p = this.parent;
+		while(p instanceof Widget) {
+			p = p.parent;
+		}
+		return p;
+	}
+	
+	/**
+	 * Position relative to the host.
+	**/
+	get offset() {
+		let x = 0, y = 0;
+		for(let w = this; w instanceof Widget; w = w.parent) {
+			x += w.bounds.x;
+			y += w.bounds.y;
+		}
+		return {x, y};
+	}
+	
+	/**
+	 * Add to a widget or a frame. Frames host the subtree, painting it
+	 *  and routing its input.
+	**/
+	addTo(parent, before=null) {
+		this.remove();
+		
+		let bid = before? before.id : 0;
+		if(parent instanceof Widget) {
+			native.viewInsert(parent.id, this.id, bid);
+			
+			let
+				siblings = parent.children,
+				i = before? siblings.indexOf(before) : -1;
+			siblings.splice(i === -1? siblings.length : i, 0, this);
+		}
+		else {
+			native.viewInsert(parent.viewRoot, this.id, bid);
+			host(parent).add(this);
+		}
+		
+		this.parent = parent;
+		this.damage();
+		return this;
+	}
+	
+	add(...children) {
+		for(let c of children) {
+			c.addTo(this);
+		}
+		return this;
+	}
+	
+	remove() {
+		if(!this.parent) {
+			return false;
+		}
+		
+		this.damage();
+		native.viewDetach(this.id);
+		
+		if(this.parent instanceof Widget) {
+			let siblings = this.parent.children, i = siblings.indexOf(this);
+			if(i !== -1) {
+				siblings.splice(i, 1);
+			}
+		}
+		else {
+			this.parent[HOSTED].delete(this);
+		}
+		this.parent = null;
+		return true;
+	}
+	
+	/**
+	 * Destroy this and everything under it.
+	**/
+	destroy() {
+		this.remove();
+		forget(this);
+		native.viewDestroy(this.id);
+	}
+	
+	/**
+	 * Ask the host to repaint the widget's area.
+	**/
+	damage() {
+		let h = this.parent && this.host;
+		if(h && this.visible && this.bounds.w && this.bounds.h) {
+			let {x, y} = this.offset;
+			h.damage(x, y, this.bounds.w, this.bounds.h);
+		}
+		return this;
+	}
+	
+	/**
+	 * Emit an input event here, or on the closest ancestor listening for
+	 *  it.
+	**/
+	dispatch(name, ev) {
+		for(let w = this; w instanceof Widget; w = w.parent) {
+			if(w.listenerCount(name)) {
+				w.emit(name, ev);
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	/**
+	 * Draw with the canvas' origin at the widget's top left.
+	**/
+	draw(g) {}
+	
+	static fromView(id) {
+		return widgets.get(id) || null;
+	}
+}
+
+function forget(w) {
+	widgets.delete(w.id);
+	for(let c of w.children) {
+		forget(c);
+	}
+}
+
+/**
+ * Start routing a frame's input to the widgets it hosts and painting
+ *  them with it, returning the set of those directly under it.
+**/
+function host(frame) {
+	if(frame[HOSTED]) {
+		return frame[HOSTED];
+	}
+	let hosted = frame[HOSTED] = new Set();
+	
+	for(let name of ROUTED) {
+		frame.on(name, ev => {
+			let id = native.viewHitTest(frame.viewRoot, ev.x, ev.y);
+			if(id) {
+				widgets.get(id).dispatch(name, ev);
+			}
+		});
+	}
+	
+	frame.on('paint', (g, damage) => paintWidgets(frame, g, damage));
+	frame.paintOnDraw();
+	
+	// The frame takes the native nodes with it
+	frame.once('destroy', () => {
+		for(let w of hosted) {
+			forget(w);
+		}
+		hosted.clear();
+	});
+	
+	return hosted;
+}
+
+/**
+ * Paint the widgets a frame hosts which touch the damage, in order,
+ *  through a Canvas whose origin is moved to each in turn.
+**/
+function paintWidgets(frame, canvas, damage) {
+	if(!frame[HOSTED] || !frame[HOSTED].size) {
+		return;
+	}
+	
+	let
+		clip = damage? damage[NATIVE] : undefined,
+		list = native.viewPaintList(frame.viewRoot, clip),
+		ox = canvas.x, oy = canvas.y;
+	
+	for(let i = 0; i < list.length; i += 3) {
+		let w = widgets.get(list[i]);
+		if(w) {
+			canvas.x = ox + list[i + 1];
+			canvas.y = oy + list[i + 2];
+			w.draw(canvas);
+		}
+	}
+	
+	canvas.x = ox;
+	canvas.y = oy;
+}
+
+module.exports = {
+	Widget
+};
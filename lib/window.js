@@ -3,16 +3,23 @@
 const
 	Color = require("./color"),
 	{Container} = require("./container"),
-	{native, NATIVE, COLORMAP} = require("./native");
+	{native, NATIVE, COLORMAP, defineNative} = require("./native"),
+	{Frame, openFonts} = require("./frame");
 
 class Window extends Container {
 	constructor(config={}, children=[]) {
 		super(config, children);
 		
-		this.on('draw', ev => {
-			let g = new GraphicsContext(this, config);
-			this.draw(g);
-		});
+		// Keep the last drawing so exposures are answered natively
+		//  instead of calling draw again
+		this.retain = !!config.retain;
+		
+		if(config.buffered) {
+			this.setBuffered(true);
+		}
+		
+		// Windowless widgets are drawn by the frame too, see Frame.paint
+		this.paintOnDraw(config);
 	}
 	
 	get title() {
@@ -41,12 +48,86 @@ const fontmap = {
 		else {
 			return this.fonts[name] = native.openFont(name);
 		}
+	},
+	
+	/**
+	 * Open fonts ahead of time in one round trip, so the first draw
+	 *  doesn't stall on them. Resolves once all their metrics are in.
+	**/
+	load: function(...names) {
+		names = names.map(name => (name + "").toLowerCase())
+			.filter(name => typeof this.fonts[name] !== 'number');
+		
+		let {ids, loads, loaded} = openFonts(names);
+		
+		// Ids are usable right away, so draws before the metrics are in
+		//  don't open the fonts a second time
+		names.forEach((name, i) => this.fonts[name] = ids[i]);
+		
+		// Forget only the fonts that failed, and only while their names
+		//  are still mapped to what this load opened
+		loads.forEach((load, i) => load.catch(() => {
+			if(this.fonts[names[i]] === ids[i]) {
+				delete this.fonts[names[i]];
+			}
+		}));
+		
+		return loaded.then(() => this);
+	},
+	
+	/**
+	 * Width of the text in the given font. Metrics are cached when the
+	 *  font is opened, so this never waits on the server, and widths are
+	 *  kept per font so laying out the same labels again doesn't cross
+	 *  into native code.
+	**/
+	measure: function(name, text) {
+		text += "";
+		let widths = this.widthsOf(this.get(name)), w = widths.get(text);
+		if(typeof w !== 'number') {
+			w = native.measureText(this.get(name), text);
+			widths.set(text, w);
+		}
+		return w;
+	},
+	measureAll: function(name, texts) {
+		let
+			id = this.get(name), widths = this.widthsOf(id),
+			missing = texts.map(String).filter(t => !widths.has(t));
+		
+		if(missing.length) {
+			let ws = native.measureTexts(id, ...missing);
+			missing.forEach((t, i) => widths.set(t, ws[i]));
+		}
+		return texts.map(t => widths.get(t + ""));
+	},
+	
+	// Widths by font id then text, each dropped whole once it's big
+	widths: new Map(),
+	widthsOf: function(id) {
+		let widths = this.widths.get(id);
+		if(!widths || widths.size > 4096) {
+			this.widths.set(id, widths = new Map());
+		}
+		return widths;
+	},
+	
+	/**
+	 * {ascent, descent} of the font.
+	**/
+	extents: function(name) {
+		return native.fontExtents(this.get(name));
 	}
 };
 
 class GraphicsContext {
 	constructor(w, config) {
 		this.target = w;
+		this.font = config.font || null;
+		
+		// Alpha of the foreground and the opacity it's scaled by
+		this.fgAlpha = config.fg? Color(config.fg).a : 0xff;
+		this.opacity = 1;
 		
 		let map = w[COLORMAP];
 		defineNative(this, new native.NativeGraphicsContext(
@@ -59,26 +140,127 @@ class GraphicsContext {
 			
 			config.font? fontmap.get(config.font) : 0
 		));
+		this.updateAlpha();
+	}
+	
+	/**
+	 * Tell the native side what alpha to draw with. Anything under 255
+	 *  is blended with RENDER rather than painted over.
+	**/
+	updateAlpha() {
+		let a = Math.round(this.fgAlpha*this.opacity);
+		this[NATIVE].setAlpha(Math.max(0, Math.min(a, 0xff)));
 	}
 	
+	/**
+	 * Change any of the style properties accepted by the constructor,
+	 *  along with lineStyle, capStyle, joinStyle, fillStyle, clipX,
+	 *  clipY, dashes, dashOffset, arcMode and opacity. Only what's given
+	 *  gets sent to the server. Empty dashes go back to solid lines.
+	**/
 	setStyle(config) {
-		let map = this.target[COLORMAP];
-		this[NATIVE].setStyle(
-			map.get(config.fg), map.get(config.bg),
-			config.lineWidth|0, fontmap.get(config.font)
-		);
+		let map = this.target[COLORMAP], n = this[NATIVE];
+		
+		if('fg' in config) {
+			n.setFG(map.get(config.fg));
+			this.fgAlpha = Color(config.fg).a;
+		}
+		if('opacity' in config) {
+			this.opacity = +config.opacity;
+		}
+		if('fg' in config || 'opacity' in config) {
+			this.updateAlpha();
+		}
+		if('bg' in config) {
+			n.setBG(map.get(config.bg));
+		}
+		if('lineWidth' in config) {
+			n.setLineWidth(config.lineWidth|0);
+		}
+		if('font' in config) {
+			n.setFont(fontmap.get(config.font));
+			this.font = config.font;
+		}
+		
+		if('lineStyle' in config) {
+			n.setLineStyle(GraphicsContext.LINE_STYLES[config.lineStyle]);
+		}
+		if('capStyle' in config) {
+			n.setCapStyle(GraphicsContext.CAP_STYLES[config.capStyle]);
+		}
+		if('joinStyle' in config) {
+			n.setJoinStyle(GraphicsContext.JOIN_STYLES[config.joinStyle]);
+		}
+		if('fillStyle' in config) {
+			n.setFillStyle(GraphicsContext.FILL_STYLES[config.fillStyle]);
+		}
+		if('clipX' in config || 'clipY' in config) {
+			n.setClipOrigin(config.clipX|0, config.clipY|0);
+		}
+		if('dashes' in config) {
+			let dashes = config.dashes;
+			n.setDashes(
+				config.dashOffset|0,
+				...(typeof dashes === 'number'? [dashes] : dashes)
+			);
+		}
+		if('arcMode' in config) {
+			n.setArcMode(GraphicsContext.ARC_MODES[config.arcMode]);
+		}
+		
+		return this;
+	}
+	
+	/**
+	 * Collect draws until submit() instead of sending each right away,
+	 *  so they can be merged and sent with as few GC changes as
+	 *  possible.
+	**/
+	record() {
+		this[NATIVE].record();
+		return this;
+	}
+	
+	/**
+	 * Clip everything drawn to a Region, or stop clipping with null.
+	 *  The clip is the frame's, so it's shared by every context drawing
+	 *  to it.
+	**/
+	setClip(region) {
+		if(region) {
+			this[NATIVE].setClip(region[NATIVE]);
+		}
+		else {
+			this[NATIVE].setClip();
+		}
 		return this;
 	}
 	
 	/**
-	 * Draw the given points using the foreground color.
+	 * Send everything since record(). If retain is true, the drawing
+	 *  is kept to repaint exposures without another draw event.
+	**/
+	submit(retain) {
+		this[NATIVE].submit(!!retain);
+		return this;
+	}
+	
+	/**
+	 * Draw the given points using the foreground color. Instead of
+	 *  objects, a single Int16Array of x, y pairs can be given, which is
+	 *  handed to the server without conversion.
 	 *
 	 * @param rel True if the points are relative to each other.
 	**/
 	drawPoints(rel, ...points) {
-		this[NATIVE].drawPoints(
-			!!rel, ...points.map(v => ({x: v.x|0, y: v.y|0}))
-		);
+		if(ArrayBuffer.isView(points[0])) {
+			this[NATIVE].drawPoints(!!rel, points[0]);
+		}
+		else {
+			this[NATIVE].drawPoints(
+				!!rel, ...points.map(v => ({x: v.x|0, y: v.y|0}))
+			);
+		}
 		return this;
 	}
 	drawPoint(x, y) {
@@ -90,12 +272,18 @@ class GraphicsContext {
 	 * Draw the given lines using the foreground color.
 	 *
 	 * @param rel True if the points are relative to each other.
+	 * @param lines Objects, or one Int16Array of x1, y1, x2, y2.
 	**/
 	drawLines(rel, ...lines) {
-		this[NATIVE].drawLines(!!rel, ...lines.map(v => ({
-			x1: v.x1|0, y1: v.y1|0,
-			x2: v.x2|0, y2: v.y2|0
-		})));
+		if(ArrayBuffer.isView(lines[0])) {
+			this[NATIVE].drawLines(!!rel, lines[0]);
+		}
+		else {
+			this[NATIVE].drawLines(!!rel, ...lines.map(v => ({
+				x1: v.x1|0, y1: v.y1|0,
+				x2: v.x2|0, y2: v.y2|0
+			})));
+		}
 		return this;
 	}
 	drawLine(x1, y1, x2, y2) {
@@ -106,12 +294,18 @@ class GraphicsContext {
 	 * Draw a bunch of rectangles using the foreground color.
 	 *
 	 * @param fill Switch between stroking and filling.
+	 * @param rects Objects, or one Int16Array of x, y, w, h.
 	**/
 	drawRects(fill, ...rects) {
-		this[NATIVE].drawRects(!!fill, ...rects.map(v => ({
-			x: v.x|0, y: v.y|0,
-			w: v.w|0, h: v.h|0
-		})));
+		if(ArrayBuffer.isView(rects[0])) {
+			this[NATIVE].drawRects(!!fill, rects[0]);
+		}
+		else {
+			this[NATIVE].drawRects(!!fill, ...rects.map(v => ({
+				x: v.x|0, y: v.y|0,
+				w: v.w|0, h: v.h|0
+			})));
+		}
 		return this;
 	}
 	drawRect(fill, x, y, w, h) {
@@ -140,18 +334,72 @@ class GraphicsContext {
 		this[NATIVE].drawText(x|0, y|0, text + "");
 		return this;
 	}
+	
+	/**
+	 * Copy an Image, or the part of it given by sx, sy, w, h, to x, y.
+	**/
+	putImage(image, x, y, sx=0, sy=0, w=image.width, h=image.height) {
+		this[NATIVE].putImage(image[NATIVE], sx|0, sy|0, x|0, y|0, w|0, h|0);
+		return this;
+	}
+	
+	/**
+	 * Width of the text in the current font.
+	**/
+	measureText(text) {
+		return this.font? fontmap.measure(this.font, text) : 0;
+	}
 }
 
+// Names for the X values of each style property
+GraphicsContext.LINE_STYLES = {solid: 0, onOffDash: 1, doubleDash: 2};
+GraphicsContext.CAP_STYLES = {notLast: 0, butt: 1, round: 2, projecting: 3};
+GraphicsContext.JOIN_STYLES = {miter: 0, round: 1, bevel: 2};
+GraphicsContext.FILL_STYLES = {
+	solid: 0, tiled: 1, stippled: 2, opaqueStippled: 3
+};
+GraphicsContext.ARC_MODES = {chord: 0, pieSlice: 1};
+
 class Canvas extends GraphicsContext {
 	constructor(target, config) {
 		super(target, config);
 		
-		this.x = config.x;
-		this.y = config.y;
+		this.x = config.x|0;
+		this.y = config.y|0;
+		this._viewstack = [];
 	}
 	
+	/**
+	 * Copy of a packed shape array with the first count coordinates of
+	 *  every stride up to end moved by the canvas offset.
+	**/
+	offsetView(view, stride, count, end=view.length) {
+		if(!this.x && !this.y) {
+			return view;
+		}
+		
+		let out = new view.constructor(view);
+		for(let i = 0; i < Math.min(end, out.length); i += stride) {
+			for(let j = 0; j < count; j += 2) {
+				out[i + j] += this.x;
+				out[i + j + 1] += this.y;
+			}
+		}
+		return out;
+	}
+	
+	/**
+	 * Relative points are each from the one before, so only the first
+	 *  is moved.
+	**/
 	drawPoints(rel, ...points) {
-		for(let p of points) {
+		if(ArrayBuffer.isView(points[0])) {
+			return super.drawPoints(
+				rel, this.offsetView(points[0], 2, 2, rel? 2 : undefined)
+			);
+		}
+		
+		for(let p of rel? points.slice(0, 1) : points) {
 			p.x += this.x;
 			p.y += this.y;
 		}
@@ -159,19 +407,35 @@ class Canvas extends GraphicsContext {
 		return super.drawPoints(rel, ...points);
 	}
 	
+	/**
+	 * A relative line's end is from its start, so only the start is
+	 *  moved.
+	**/
 	drawLines(rel, ...lines) {
+		if(ArrayBuffer.isView(lines[0])) {
+			return super.drawLines(
+				rel, this.offsetView(lines[0], 4, rel? 2 : 4)
+			);
+		}
+		
 		for(let line of lines) {
 			line.x1 += this.x;
-			line.x2 += this.x;
-			
 			line.y1 += this.y;
-			line.y2 += this.y;
+			
+			if(!rel) {
+				line.x2 += this.x;
+				line.y2 += this.y;
+			}
 		}
 		
-		return super.drawLines(rel, lines);
+		return super.drawLines(rel, ...lines);
 	}
 	
 	drawRects(fill, ...rects) {
+		if(ArrayBuffer.isView(rects[0])) {
+			return super.drawRects(fill, this.offsetView(rects[0], 4, 2));
+		}
+		
 		for(let rect of rects) {
 			rect.x += this.x;
 			rect.y += this.y;
@@ -184,6 +448,10 @@ class Canvas extends GraphicsContext {
 		return super.drawText(x + this.x, y + this.y, text);
 	}
 	
+	putImage(image, x, y, ...rest) {
+		return super.putImage(image, x + this.x, y + this.y, ...rest);
+	}
+	
 	pushView(view) {
 		this._viewstack.push(view);
 		this.x += view.x;
@@ -199,6 +467,8 @@ class Canvas extends GraphicsContext {
 	}
 }
 
+Frame.Canvas = Canvas;
+
 module.exports = {
-	Window, GraphicsContext, Canvas
+	Window, GraphicsContext, Canvas, fonts: fontmap
 };
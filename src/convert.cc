@@ -0,0 +1,224 @@
+/**
+ * This file is intended to be included into native.cpp
+ *
+ * Conversion of 32-bit RGBA words (r<<24|g<<16|b<<8|a, as packed by
+ *  lib/color.js) into what the server wants. Each conversion has SSE2
+ *  and AVX2 kernels alongside the scalar one, picked once by what the
+ *  CPU supports.
+**/
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+	#define SATORI_X86
+#endif
+
+namespace convert {
+
+enum Kind {
+	// 24-bit visuals with red, green, blue in the low three bytes
+	XRGB,
+	// Premultiplied ARGB, as XRender's ARGB32 format wants it
+	ARGB_PREMUL
+};
+
+enum Kernel {
+	AUTO, SCALAR, SSE2, AVX2
+};
+
+typedef void (*kernel_t)(const uint32_t* in, uint32_t* out, size_t n);
+
+/**
+ * c*a/255, rounded, without a division.
+**/
+inline uint mul_div255(uint c, uint a) {
+	uint t = c*a + 128;
+	return (t + (t>>8))>>8;
+}
+
+void xrgb_scalar(const uint32_t* in, uint32_t* out, size_t n) {
+	for(size_t i = 0; i < n; ++i) {
+		out[i] = in[i]>>8;
+	}
+}
+
+void argb_premul_scalar(const uint32_t* in, uint32_t* out, size_t n) {
+	for(size_t i = 0; i < n; ++i) {
+		uint32_t w = in[i];
+		uint a = w&0xff;
+		
+		out[i] = (a<<24) |
+			(mul_div255(w>>24, a)<<16) |
+			(mul_div255((w>>16)&0xff, a)<<8) |
+			mul_div255((w>>8)&0xff, a);
+	}
+}
+
+#ifdef SATORI_X86
+
+__attribute__((target("sse2")))
+void xrgb_sse2(const uint32_t* in, uint32_t* out, size_t n) {
+	size_t i = 0;
+	for(; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+		_mm_storeu_si128((__m128i*)(out + i), _mm_srli_epi32(v, 8));
+	}
+	xrgb_scalar(in + i, out + i, n - i);
+}
+
+/**
+ * Premultiply 8 pixels' worth of 16-bit channels, laid out b, g, r, a.
+ *  The alpha lanes come out as a*a/255 and get replaced by the caller.
+**/
+__attribute__((target("sse2")))
+inline __m128i premul_epi16_sse2(__m128i c) {
+	__m128i a = _mm_shufflehi_epi16(
+		_mm_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3)),
+		_MM_SHUFFLE(3, 3, 3, 3)
+	);
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(c, a), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("sse2")))
+void argb_premul_sse2(const uint32_t* in, uint32_t* out, size_t n) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+	
+	size_t i = 0;
+	for(; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+		
+		// RGBA to ARGB is a rotate by 8
+		v = _mm_or_si128(_mm_srli_epi32(v, 8), _mm_slli_epi32(v, 24));
+		
+		__m128i lo = premul_epi16_sse2(_mm_unpacklo_epi8(v, zero));
+		__m128i hi = premul_epi16_sse2(_mm_unpackhi_epi8(v, zero));
+		__m128i p = _mm_packus_epi16(lo, hi);
+		
+		p = _mm_or_si128(
+			_mm_andnot_si128(alpha, p), _mm_and_si128(alpha, v)
+		);
+		_mm_storeu_si128((__m128i*)(out + i), p);
+	}
+	argb_premul_scalar(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void xrgb_avx2(const uint32_t* in, uint32_t* out, size_t n) {
+	size_t i = 0;
+	for(; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_srli_epi32(v, 8));
+	}
+	xrgb_scalar(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+inline __m256i premul_epi16_avx2(__m256i c) {
+	__m256i a = _mm256_shufflehi_epi16(
+		_mm256_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3)),
+		_MM_SHUFFLE(3, 3, 3, 3)
+	);
+	__m256i t = _mm256_add_epi16(
+		_mm256_mullo_epi16(c, a), _mm256_set1_epi16(128)
+	);
+	return _mm256_srli_epi16(
+		_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8
+	);
+}
+
+/**
+ * Same as the SSE2 kernel. Unpacking and packing both work within
+ *  128-bit lanes, so pixels come back out in the order they went in.
+**/
+__attribute__((target("avx2")))
+void argb_premul_avx2(const uint32_t* in, uint32_t* out, size_t n) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i alpha = _mm256_set1_epi32(0xff000000);
+	
+	size_t i = 0;
+	for(; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+		
+		v = _mm256_or_si256(
+			_mm256_srli_epi32(v, 8), _mm256_slli_epi32(v, 24)
+		);
+		
+		__m256i lo = premul_epi16_avx2(_mm256_unpacklo_epi8(v, zero));
+		__m256i hi = premul_epi16_avx2(_mm256_unpackhi_epi8(v, zero));
+		__m256i p = _mm256_packus_epi16(lo, hi);
+		
+		p = _mm256_or_si256(
+			_mm256_andnot_si256(alpha, p), _mm256_and_si256(alpha, v)
+		);
+		_mm256_storeu_si256((__m256i*)(out + i), p);
+	}
+	argb_premul_scalar(in + i, out + i, n - i);
+}
+
+#endif
+
+bool supported(Kernel k) {
+	switch(k) {
+		case AUTO:
+		case SCALAR:
+			return true;
+		
+		case SSE2:
+		#ifdef SATORI_X86
+			return __builtin_cpu_supports("sse2");
+		#else
+			return false;
+		#endif
+		
+		case AVX2:
+		#ifdef SATORI_X86
+			return __builtin_cpu_supports("avx2");
+		#else
+			return false;
+		#endif
+	}
+	return false;
+}
+
+/**
+ * The kernel for a conversion, or nullptr if the CPU can't run it.
+**/
+kernel_t pick(Kind kind, Kernel k) {
+	if(k == AUTO) {
+		k = supported(AVX2)? AVX2 : supported(SSE2)? SSE2 : SCALAR;
+	}
+	if(!supported(k)) {
+		return nullptr;
+	}
+	
+	switch(k) {
+		case AUTO:
+		case SCALAR:
+			return kind == XRGB? xrgb_scalar : argb_premul_scalar;
+		
+		#ifdef SATORI_X86
+			case SSE2:
+				return kind == XRGB? xrgb_sse2 : argb_premul_sse2;
+			case AVX2:
+				return kind == XRGB? xrgb_avx2 : argb_premul_avx2;
+		#else
+			case SSE2:
+			case AVX2:
+				return nullptr;
+		#endif
+	}
+	return nullptr;
+}
+
+/**
+ * Convert n pixels with the fastest kernel available.
+**/
+void pixels(Kind kind, const uint32_t* in, uint32_t* out, size_t n) {
+	static kernel_t best[2] = {
+		pick(XRGB, AUTO), pick(ARGB_PREMUL, AUTO)
+	};
+	best[kind](in, out, n);
+}
+
+}
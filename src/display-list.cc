@@ -0,0 +1,409 @@
+/**
+ * This file is intended to be included into native.cpp
+ *
+ * A display list records draw calls so a whole frame can be sent at
+ *  once, with style changes only where the style actually changes and
+ *  runs of the same primitive merged into one request. Everything
+ *  lives in flat arrays which keep their capacity between frames.
+**/
+
+struct DisplayList {
+	enum Op {
+		POINTS, POINTS_REL, SEGMENTS, RECTS, FILL_RECTS, TEXT, IMAGE
+	};
+	
+	struct Command {
+		Op op;
+		// Index into styles
+		uint style;
+		// Range of the op's array, or of text for TEXT
+		uint start, count;
+		// Text origin
+		int x, y;
+	};
+	
+	std::vector<display::Style> styles;
+	std::vector<Command> commands;
+	
+	std::vector<xcb_point_t> points;
+	std::vector<xcb_segment_t> segments;
+	std::vector<xcb_rectangle_t> rects;
+	std::string text;
+	
+	struct ImagePut {
+		Image* image;
+		int sx, sy, dx, dy;
+		uint w, h;
+	};
+	std::vector<ImagePut> images;
+	
+	bool empty() {
+		return commands.empty();
+	}
+	
+	void clear() {
+		styles.clear();
+		commands.clear();
+		points.clear();
+		segments.clear();
+		rects.clear();
+		text.clear();
+		images.clear();
+	}
+	
+	uint useStyle(const display::Style& style) {
+		if(styles.empty() || styles.back() != style) {
+			styles.push_back(style);
+		}
+		return styles.size() - 1;
+	}
+	
+	template<typename T>
+	void append(
+		std::vector<T>& arena, Op op, const display::Style& style,
+		const T* data, uint n
+	) {
+		uint si = useStyle(style);
+		
+		// Relative points continue from the previous point, so each
+		//  list has to stay its own request
+		if(commands.size() && op != POINTS_REL) {
+			auto& last = commands.back();
+			if(last.op == op && last.style == si) {
+				arena.insert(arena.end(), data, data + n);
+				last.count += n;
+				return;
+			}
+		}
+		
+		commands.push_back(Command{op, si, (uint)arena.size(), n, 0, 0});
+		arena.insert(arena.end(), data, data + n);
+	}
+	
+	void record(
+		bool rel, const display::Style& style,
+		const xcb_point_t* data, uint n
+	) {
+		append(points, rel? POINTS_REL : POINTS, style, data, n);
+	}
+	
+	void record(
+		const display::Style& style, const xcb_segment_t* data, uint n
+	) {
+		append(segments, SEGMENTS, style, data, n);
+	}
+	
+	void record(
+		bool fill, const display::Style& style,
+		const xcb_rectangle_t* data, uint n
+	) {
+		append(rects, fill? FILL_RECTS : RECTS, style, data, n);
+	}
+	
+	void record(
+		const display::Style& style, int x, int y, const std::string& s
+	) {
+		commands.push_back(Command{
+			TEXT, useStyle(style), (uint)text.size(), (uint)s.size(), x, y
+		});
+		text += s;
+	}
+	
+	void record(
+		const display::Style& style, Image* image,
+		int sx, int sy, int dx, int dy, uint w, uint h
+	) {
+		commands.push_back(Command{
+			IMAGE, useStyle(style), (uint)images.size(), 1, 0, 0
+		});
+		images.push_back(ImagePut{image, sx, sy, dx, dy, w, h});
+	}
+	
+	/**
+	 * How many items of the given size fit into one request after its
+	 *  header, which is 12 bytes for the core poly requests.
+	**/
+	static uint max_items(size_t size, size_t header=12) {
+		return (max_request_bytes() - header)/size;
+	}
+	
+	/**
+	 * Send one command's data, split into as many requests as the
+	 *  server's maximum request length needs.
+	**/
+	static void issue(
+		Op op, xcb_drawable_t target, xcb_gcontext_t gc,
+		const void* data, uint n
+	) {
+		switch(op) {
+			case POINTS:
+			case POINTS_REL: {
+				auto* pts = (const xcb_point_t*)data;
+				uint max = max_items(sizeof(xcb_point_t));
+				
+				for(uint i = 0; i < n; i += max) {
+					xcb_poly_point(conn,
+						op == POINTS_REL?
+							XCB_COORD_MODE_PREVIOUS : XCB_COORD_MODE_ORIGIN,
+						target, gc, std::min(max, n - i), pts + i
+					);
+				}
+				break;
+			}
+			
+			case SEGMENTS: {
+				auto* segs = (const xcb_segment_t*)data;
+				uint max = max_items(sizeof(xcb_segment_t));
+				
+				for(uint i = 0; i < n; i += max) {
+					xcb_poly_segment(
+						conn, target, gc, std::min(max, n - i), segs + i
+					);
+				}
+				break;
+			}
+			
+			case RECTS:
+			case FILL_RECTS: {
+				auto* rs = (const xcb_rectangle_t*)data;
+				uint max = max_items(sizeof(xcb_rectangle_t));
+				
+				for(uint i = 0; i < n; i += max) {
+					(op == FILL_RECTS?
+						xcb_poly_fill_rectangle : xcb_poly_rectangle
+					)(conn, target, gc, std::min(max, n - i), rs + i);
+				}
+				break;
+			}
+			
+			// These carry more than an array, so they're issued by
+			//  the caller
+			case TEXT:
+			case IMAGE:
+				break;
+		}
+	}
+	
+	/**
+	 * The rectangles a core rectangle outline covers, split so none of
+	 *  them overlap.
+	**/
+	static void outline(
+		const xcb_rectangle_t& r, uint lw, std::vector<xcb_rectangle_t>& out
+	) {
+		int h0 = lw/2, x = r.x - h0, y = r.y - h0;
+		uint w = r.width + lw;
+		
+		if(r.height < lw) {
+			out.push_back(xcb_rectangle_t{
+				(int16_t)x, (int16_t)y, (uint16_t)w,
+				(uint16_t)(r.height + lw)
+			});
+			return;
+		}
+		
+		uint16_t side = r.height - lw;
+		out.push_back(xcb_rectangle_t{
+			(int16_t)x, (int16_t)y, (uint16_t)w, (uint16_t)lw
+		});
+		out.push_back(xcb_rectangle_t{
+			(int16_t)x, (int16_t)(y + r.height), (uint16_t)w, (uint16_t)lw
+		});
+		if(side) {
+			out.push_back(xcb_rectangle_t{
+				(int16_t)x, (int16_t)(y + lw), (uint16_t)lw, side
+			});
+			out.push_back(xcb_rectangle_t{
+				(int16_t)(x + r.width), (int16_t)(y + lw), (uint16_t)lw, side
+			});
+		}
+	}
+	
+	/**
+	 * Segments as quads of two triangles each, line width wide and
+	 *  through the centers of the pixels at their ends, like core lines
+	 *  with butt caps.
+	**/
+	static void blend_segments(
+		xcb_drawable_t target, xcb_render_picture_t dst, uint rgba,
+		uint lw, const xcb_segment_t* segs, uint n
+	) {
+		std::vector<xcb_render_triangle_t> tris;
+		double hw = lw/2.0;
+		
+		auto fixed = [](double v) {
+			return (xcb_render_fixed_t)std::lround(v*65536);
+		};
+		auto point = [&](double x, double y) {
+			return xcb_render_pointfix_t{fixed(x + 0.5), fixed(y + 0.5)};
+		};
+		
+		for(uint i = 0; i < n; ++i) {
+			auto& seg = segs[i];
+			double dx = seg.x2 - seg.x1, dy = seg.y2 - seg.y1;
+			double len = std::sqrt(dx*dx + dy*dy);
+			if(len == 0) {
+				continue;
+			}
+			
+			double nx = -dy/len*hw, ny = dx/len*hw;
+			auto a = point(seg.x1 + nx, seg.y1 + ny),
+				b = point(seg.x1 - nx, seg.y1 - ny),
+				c = point(seg.x2 + nx, seg.y2 + ny),
+				d = point(seg.x2 - nx, seg.y2 - ny);
+			
+			tris.push_back(xcb_render_triangle_t{a, b, c});
+			tris.push_back(xcb_render_triangle_t{b, d, c});
+		}
+		
+		uint max = max_items(sizeof(xcb_render_triangle_t), 24);
+		for(size_t i = 0; i < tris.size(); i += max) {
+			track_request(xcb_render_triangles(
+				conn, XCB_RENDER_PICT_OP_OVER, solid_fill(rgba), dst,
+				a8_format, 0, 0, std::min<size_t>(max, tris.size() - i),
+				&tris[i]
+			), target, "GraphicsContext blending");
+		}
+	}
+	
+	/**
+	 * Blend a command's data onto the target with RENDER, since core
+	 *  drawing can only paint over what's there. Returns false if the
+	 *  style is opaque or RENDER can't be used.
+	**/
+	static bool blend(
+		RenderTarget& rt, Op op, xcb_drawable_t target,
+		const display::Style& style, const void* data, uint n
+	) {
+		if(!has_render || style.alpha == 0xff) {
+			return false;
+		}
+		
+		xcb_render_picture_t dst = rt.getPicture(target);
+		if(!dst) {
+			return false;
+		}
+		
+		uint rgba = rt.styleColor(style);
+		uint lw = std::max(1, style.line_width);
+		std::vector<xcb_rectangle_t> rs;
+		
+		switch(op) {
+			case POINTS:
+			case POINTS_REL: {
+				auto* pts = (const xcb_point_t*)data;
+				int x = 0, y = 0;
+				
+				for(uint i = 0; i < n; ++i) {
+					bool rel = op == POINTS_REL && i > 0;
+					x = rel? x + pts[i].x : pts[i].x;
+					y = rel? y + pts[i].y : pts[i].y;
+					rs.push_back(xcb_rectangle_t{
+						(int16_t)x, (int16_t)y, 1, 1
+					});
+				}
+				break;
+			}
+			
+			case SEGMENTS:
+				blend_segments(
+					target, dst, rgba, lw, (const xcb_segment_t*)data, n
+				);
+				return true;
+			
+			case RECTS: {
+				auto* r = (const xcb_rectangle_t*)data;
+				for(uint i = 0; i < n; ++i) {
+					outline(r[i], lw, rs);
+				}
+				break;
+			}
+			
+			case FILL_RECTS: {
+				auto* r = (const xcb_rectangle_t*)data;
+				rs.assign(r, r + n);
+				break;
+			}
+			
+			case TEXT:
+			case IMAGE:
+				return false;
+		}
+		
+		auto color = render_color(rgba);
+		uint max = max_items(sizeof(xcb_rectangle_t), 20);
+		
+		for(size_t i = 0; i < rs.size(); i += max) {
+			track_request(xcb_render_fill_rectangles(
+				conn, XCB_RENDER_PICT_OP_OVER, dst, color,
+				std::min<size_t>(max, rs.size() - i), &rs[i]
+			), target, "GraphicsContext blending");
+		}
+		return true;
+	}
+	
+	/**
+	 * Draw a command's data, blended if its style calls for it.
+	**/
+	static void draw(
+		RenderTarget& rt, Op op, xcb_drawable_t target, xcb_gcontext_t gc,
+		const display::Style& style, const void* data, uint n
+	) {
+		if(!blend(rt, op, target, style, data, n)) {
+			issue(op, target, gc, data, n);
+		}
+	}
+	
+	/**
+	 * Send everything recorded, binding GCs from the pool only when
+	 *  the style changes. gc is the GC last used by the caller, and is
+	 *  left as the one used last.
+	**/
+	void submit(
+		RenderTarget& rt, xcb_drawable_t target,
+		GCPool& gcs, xcb_gcontext_t& gc
+	) {
+		uint style = -1;
+		
+		for(auto& c : commands) {
+			if(c.style != style) {
+				gc = gcs.bind(rt, target, gc, styles[c.style]);
+				style = c.style;
+			}
+			
+			auto& st = styles[c.style];
+			switch(c.op) {
+				case POINTS:
+				case POINTS_REL:
+					draw(rt, c.op, target, gc, st, &points[c.start], c.count);
+					break;
+				case SEGMENTS:
+					draw(
+						rt, c.op, target, gc, st, &segments[c.start], c.count
+					);
+					break;
+				case RECTS:
+				case FILL_RECTS:
+					draw(rt, c.op, target, gc, st, &rects[c.start], c.count);
+					break;
+				case TEXT:
+					draw_text(
+						rt, target, gc, st, c.x, c.y, &text[c.start], c.count
+					);
+					break;
+				case IMAGE: {
+					auto& p = images[c.start];
+					
+					// A retained list can outlive its images
+					if(Image::live.count(p.image)) {
+						p.image->put(
+							rt, target, gc,
+							p.sx, p.sy, p.dx, p.dy, p.w, p.h, st.alpha
+						);
+					}
+					break;
+				}
+			}
+		}
+	}
+};
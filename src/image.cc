@@ -0,0 +1,427 @@
+/**
+ * This file is intended to be included into native.cpp
+ *
+ * Client-side images in the server's pixel format. When the server is
+ *  local the pixels live in a MIT-SHM segment it reads directly,
+ *  otherwise they're sent through the socket in chunks.
+ *
+ * ARGB images hold premultiplied alpha and are blended onto the target
+ *  with RENDER, by way of a pixmap of their own.
+**/
+
+// Whether images can try shared memory at all, checked when the first
+//  image is made
+static bool has_shm = false, shm_checked = false;
+// Event code of ShmCompletion
+static uint8_t shm_completion = 0;
+
+void init_shm() {
+	shm_checked = true;
+	
+	auto* ext = xcb_get_extension_data(conn, &xcb_shm_id);
+	if(!ext || !ext->present) {
+		return;
+	}
+	
+	auto* reply = xcb_shm_query_version_reply(
+		conn, xcb_shm_query_version(conn), nullptr
+	);
+	if(reply) {
+		has_shm = true;
+		shm_completion = ext->first_event + XCB_SHM_COMPLETION;
+		free(reply);
+	}
+}
+
+/**
+ * The server's pixmap format for a depth.
+**/
+const xcb_format_t* pixmap_format(uint depth) {
+	auto* setup = xcb_get_setup(conn);
+	auto it = xcb_setup_pixmap_formats_iterator(setup);
+	
+	for(; it.rem; xcb_format_next(&it)) {
+		if(it.data->depth == depth) {
+			return it.data;
+		}
+	}
+	return nullptr;
+}
+
+struct Image {
+	// Shared images, for matching completion events to them
+	static std::unordered_map<xcb_shm_seg_t, Image*> shared;
+	// Every image that hasn't been destroyed, so recorded puts can
+	//  tell if theirs is still around
+	static std::set<Image*> live;
+	
+	uint width, height, depth, stride;
+	uint8_t* data;
+	size_t size;
+	bool argb;
+	
+	// Server-side copy for compositing, made the first time it's needed
+	xcb_pixmap_t pixmap = 0;
+	xcb_gcontext_t pixmap_gc = 0;
+	xcb_render_picture_t picture = 0;
+	
+	// Segment the server has attached, or 0 if data is on the heap
+	xcb_shm_seg_t seg;
+	int shmid;
+	std::vector<uint8_t> heap;
+	
+	// Sequence number of the last shared put, and whether the server
+	//  might still be reading it
+	uint last_put;
+	bool busy;
+	
+	Image(uint w, uint h, bool argb):
+		width(w), height(h), data(nullptr), argb(argb),
+		seg(0), shmid(-1), last_put(0), busy(false) {
+		if(!conn) {
+			init_xcb();
+		}
+		
+		if(argb && !argb_format) {
+			throw std::runtime_error(
+				"ARGB images need the RENDER extension"
+			);
+		}
+		depth = argb? 32 : screen->root_depth;
+		
+		auto* format = pixmap_format(depth);
+		if(!format) {
+			throw std::runtime_error("No pixmap format for the screen");
+		}
+		
+		uint pad = format->scanline_pad;
+		stride = (w*format->bits_per_pixel + pad - 1)/pad*pad/8;
+		size = (size_t)stride*h;
+		
+		if(!shm_checked) {
+			init_shm();
+		}
+		if(has_shm) {
+			attach();
+		}
+		if(!seg) {
+			heap.resize(size);
+			data = heap.data();
+		}
+		
+		live.insert(this);
+	}
+	
+	Image(const Image&) = delete;
+	
+	~Image() {
+		destroy();
+	}
+	
+	/**
+	 * Set up a shared segment. Attaching fails if the server isn't on
+	 *  this machine, after which nothing else tries shared memory.
+	**/
+	void attach() {
+		shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+		if(shmid < 0) {
+			return;
+		}
+		
+		data = (uint8_t*)shmat(shmid, nullptr, 0);
+		if(data == (uint8_t*)-1) {
+			shmctl(shmid, IPC_RMID, nullptr);
+			data = nullptr;
+			return;
+		}
+		
+		seg = xcb_generate_id(conn);
+		auto* error = xcb_request_check(
+			conn, xcb_shm_attach_checked(conn, seg, shmid, 0)
+		);
+		
+		// Both sides are attached, so it can go once they detach
+		shmctl(shmid, IPC_RMID, nullptr);
+		
+		if(error) {
+			free(error);
+			shmdt(data);
+			data = nullptr;
+			seg = 0;
+			has_shm = false;
+			return;
+		}
+		
+		shared[seg] = this;
+	}
+	
+	void destroy() {
+		if(!data) {
+			return;
+		}
+		
+		if(pixmap) {
+			xcb_render_free_picture(conn, picture);
+			xcb_free_gc(conn, pixmap_gc);
+			xcb_free_pixmap(conn, pixmap);
+			pixmap = 0;
+		}
+		
+		if(seg) {
+			// The server may still be reading from it
+			sync();
+			
+			xcb_shm_detach(conn, seg);
+			shmdt(data);
+			shared.erase(seg);
+			seg = 0;
+		}
+		else {
+			std::vector<uint8_t>().swap(heap);
+		}
+		
+		data = nullptr;
+		live.erase(this);
+	}
+	
+	bool isShared() {
+		return seg != 0;
+	}
+	
+	/**
+	 * Wait until the server is done reading the pixels.
+	**/
+	void sync() {
+		if(busy) {
+			// Any round trip means everything before it was handled
+			free(xcb_get_input_focus_reply(
+				conn, xcb_get_input_focus(conn), nullptr
+			));
+			busy = false;
+		}
+	}
+	
+	/**
+	 * Called with the sequence of a ShmCompletion for this image.
+	**/
+	void completed(uint sequence) {
+		if(sequence == last_put) {
+			busy = false;
+		}
+	}
+	
+	/**
+	 * Fill the image from RGBA words (as packed by lib/color.js), row by
+	 *  row from the top left.
+	**/
+	void writePixels(const uint32_t* rgba, size_t n) {
+		if(!data) {
+			return;
+		}
+		
+		auto* v = root_visual;
+		uint bpp = pixmap_format(depth)->bits_per_pixel;
+		bool lsb =
+			xcb_get_setup(conn)->image_byte_order == XCB_IMAGE_ORDER_LSB_FIRST;
+		auto kind = argb? convert::ARGB_PREMUL : convert::XRGB;
+		
+		// The common case of a little-endian 24-bit visual is only a
+		//  shift per pixel, which the conversion kernels handle. ARGB
+		//  always has the layout they write.
+		bool fast = bpp == 32 && lsb &&
+			__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && (argb || (
+				v->red_mask == 0xff0000 && v->green_mask == 0xff00 &&
+				v->blue_mask == 0xff
+			));
+		
+		for(uint y = 0; y < height && n; ++y) {
+			size_t count = std::min<size_t>(width, n);
+			uint8_t* row = data + (size_t)y*stride;
+			
+			if(fast) {
+				convert::pixels(kind, rgba, (uint32_t*)row, count);
+			}
+			else {
+				for(size_t x = 0; x < count; ++x) {
+					uint c = rgba[x], pixel;
+					if(argb) {
+						convert::argb_premul_scalar(&c, &pixel, 1);
+					}
+					else {
+						pixel =
+							scale_channel(c>>24, v->red_mask) |
+							scale_channel((c>>16)&0xff, v->green_mask) |
+							scale_channel((c>>8)&0xff, v->blue_mask);
+					}
+					
+					// Bytes go in the server's order
+					for(uint b = 0; b < bpp/8; ++b) {
+						uint shift = lsb? 8*b : bpp - 8*(b + 1);
+						row[x*bpp/8 + b] = pixel>>shift;
+					}
+				}
+			}
+			
+			rgba += count;
+			n -= count;
+		}
+	}
+	
+	/**
+	 * Copy part of the image to a drawable. ARGB images, and any image
+	 *  drawn with an alpha under 255, are blended onto it instead. So
+	 *  are images of another depth, such as opaque ones on an ARGB
+	 *  frame, since RENDER converts between formats.
+	**/
+	void put(
+		RenderTarget& rt, xcb_drawable_t target, xcb_gcontext_t gc,
+		int sx, int sy, int dx, int dy, uint w, uint h, uint8_t alpha
+	) {
+		if(!data) {
+			return;
+		}
+		
+		// Keep the source inside the image
+		if(sx < 0) {
+			dx -= sx;
+			w = (uint)-sx < w? w + sx : 0;
+			sx = 0;
+		}
+		if(sy < 0) {
+			dy -= sy;
+			h = (uint)-sy < h? h + sy : 0;
+			sy = 0;
+		}
+		w = std::min(w, sx < (int)width? width - sx : 0);
+		h = std::min(h, sy < (int)height? height - sy : 0);
+		
+		if(!w || !h) {
+			return;
+		}
+		
+		bool blend = argb || alpha < 0xff || depth != rt.depth;
+		if(blend && has_render) {
+			xcb_render_picture_t dst = rt.getPicture(target);
+			if(dst && ensurePixmap()) {
+				upload(pixmap, pixmap_gc, sx, sy, sx, sy, w, h);
+				
+				auto mask = alpha < 0xff? solid_fill(0xffffff00|alpha) : 0;
+				track_request(xcb_render_composite(
+					conn, XCB_RENDER_PICT_OP_OVER, picture, mask, dst,
+					sx, sy, 0, 0, dx, dy, w, h
+				), target, "GraphicsContext.putImage()");
+				return;
+			}
+		}
+		
+		// Pixels can only be copied as they are between equal depths
+		if(depth != rt.depth) {
+			return;
+		}
+		upload(target, gc, sx, sy, dx, dy, w, h);
+	}
+	
+	/**
+	 * Make the pixmap images are composited from, returning whether
+	 *  there is one.
+	**/
+	bool ensurePixmap() {
+		if(pixmap) {
+			return true;
+		}
+		
+		auto format = argb? argb_format : visual_format(screen->root_visual);
+		if(!format) {
+			return false;
+		}
+		
+		pixmap = xcb_generate_id(conn);
+		xcb_create_pixmap(conn, depth, pixmap, screen->root, width, height);
+		
+		pixmap_gc = xcb_generate_id(conn);
+		xcb_create_gc(conn, pixmap_gc, pixmap, 0, nullptr);
+		
+		picture = xcb_generate_id(conn);
+		xcb_render_create_picture(conn, picture, pixmap, format, 0, nullptr);
+		return true;
+	}
+	
+	/**
+	 * Send pixels that are already clipped to the image.
+	**/
+	void upload(
+		xcb_drawable_t target, xcb_gcontext_t gc,
+		int sx, int sy, int dx, int dy, uint w, uint h
+	) {
+		if(seg) {
+			auto cookie = xcb_shm_put_image(
+				conn, target, gc, width, height, sx, sy, w, h, dx, dy,
+				depth, XCB_IMAGE_FORMAT_Z_PIXMAP, 1, seg, 0
+			);
+			track_request(cookie, target, "GraphicsContext.putImage()");
+			
+			last_put = cookie.sequence;
+			busy = true;
+			return;
+		}
+		
+		putChunked(target, gc, sx, sy, dx, dy, w, h);
+	}
+	
+	/**
+	 * Send pixels through the socket, as many rows per request as fit.
+	**/
+	void putChunked(
+		xcb_drawable_t target, xcb_gcontext_t gc,
+		int sx, int sy, int dx, int dy, uint w, uint h
+	) {
+		auto* format = pixmap_format(depth);
+		uint bpp = format->bits_per_pixel, pad = format->scanline_pad;
+		uint row = (w*bpp + pad - 1)/pad*pad/8;
+		uint rows = std::max(1u, (max_request_bytes() - 32)/row);
+		
+		// Whole rows can be sent straight from the image, anything
+		//  narrower has to be packed first
+		bool whole = sx == 0 && w == width;
+		std::vector<uint8_t> packed;
+		
+		for(uint y = 0; y < h; y += rows) {
+			uint n = std::min(rows, h - y);
+			const uint8_t* src = data + (size_t)(sy + y)*stride;
+			
+			if(!whole) {
+				packed.resize((size_t)row*n);
+				for(uint i = 0; i < n; ++i) {
+					memcpy(
+						&packed[(size_t)i*row],
+						src + (size_t)i*stride + sx*bpp/8, w*bpp/8
+					);
+				}
+				src = packed.data();
+			}
+			
+			track_request(xcb_put_image(
+				conn, XCB_IMAGE_FORMAT_Z_PIXMAP, target, gc,
+				w, n, dx, dy + y, 0, depth, (size_t)row*n, src
+			), target, "GraphicsContext.putImage()");
+		}
+	}
+};
+std::unordered_map<xcb_shm_seg_t, Image*> Image::shared;
+std::set<Image*> Image::live;
+
+/**
+ * Swallow ShmCompletion events, marking their image as free to write.
+**/
+bool shm_completed(xcb_generic_event_t* xcb_ev) {
+	if(!shm_completion || (xcb_ev->response_type & ~0x80) != shm_completion) {
+		return false;
+	}
+	
+	auto* ev = (xcb_shm_completion_event_t*)xcb_ev;
+	auto it = Image::shared.find(ev->shmseg);
+	if(it != Image::shared.end()) {
+		it->second->completed(xcb_ev->full_sequence);
+	}
+	return true;
+}
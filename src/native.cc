@@ -1,5 +1,10 @@
 #include <xcb/xcb.h>
 #include <xcb/xcb_ewmh.h>
+#include <xcb/xcbext.h>
+#include <xcb/render.h>
+#include <xcb/shm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 
 #include "native-interface.hpp"
 #include "x11error.hpp"
@@ -11,8 +16,13 @@
 #include <sstream>
 #include <iomanip>
 #include <set>
+#include <deque>
+#include <unordered_map>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <cmath>
 
-#define GC_STYLE_LEN 8
 #define WIN_ATTR_LEN 8
 
 // Styleguide exception: everything is in this namespace, so it's
@@ -27,15 +37,35 @@ typedef uint32_t uint;
 static xcb_connection_t* conn = nullptr;
 static xcb_screen_t* screen = nullptr;
 
+// The visual of the root window, which frames are created with
+static xcb_visualtype_t* root_visual = nullptr;
+
 static xcb_ewmh_connection_t ewmh;
 
+// XCB has no way to peek at its event queue, so eventsQueued() stores
+//  what it finds here for the next pollEvent()
+static xcb_generic_event_t* peeked_event = nullptr;
+
+// Events translated but not yet handed to JS
+static std::deque<event::Any> event_queue;
+
+// Expose series which haven't seen their count == 0 event yet
+static std::unordered_map<frame_id_t, event::window::Draw>
+	partial_exposes;
+
 #include "keysym.cc"
+#include "convert.cc"
+#include "render.cc"
+#include "region.cc"
+#include "viewtree.cc"
+#include "rowindex.cc"
 
 static struct _Janitor {
 	~_Janitor() {
 		// screen doesn't need to be freed (TODO: verify this)
 		xcb_disconnect(conn);
 		deinit_keysym();
+		deinit_render();
 	}
 } _janitor;
 
@@ -43,7 +73,7 @@ static struct _Janitor {
 //  so we can batch x server messages
 template<typename T>
 struct Dirty {
-	bool dirty;
+	bool dirty = false;
 	T value;
 	
 	void set(T v) {
@@ -90,6 +120,9 @@ std::string xcb_describeError(xcb_generic_error_t* error) {
 		case XERR_BAD_NAME: return "bad name";
 		case XERR_BAD_LENGTH: return "bad length";
 		case XERR_BAD_IMPL: return "server error";
+		
+		// Extension errors, like RENDER's and SHM's
+		default: return "error code " + std::to_string(error->error_code);
 	}
 	
 	return desc + std::to_string(error->minor_code);
@@ -101,9 +134,105 @@ std::runtime_error buildError(const std::string& what, xcb_generic_error_t* erro
 	);
 }
 
+xcb_visualtype_t* find_visual(xcb_visualid_t id) {
+	auto depths = xcb_screen_allowed_depths_iterator(screen);
+	for(; depths.rem; xcb_depth_next(&depths)) {
+		auto visuals = xcb_depth_visuals_iterator(depths.data);
+		for(; visuals.rem; xcb_visualtype_next(&visuals)) {
+			if(visuals.data->visual_id == id) {
+				return visuals.data;
+			}
+		}
+	}
+	
+	return nullptr;
+}
+
+// Requests are sent unchecked, so their errors come back later through
+//  the event queue. Remember enough about each one to say where an
+//  error came from and who should hear about it.
+struct RequestSite {
+	uint sequence;
+	frame_id_t owner;
+	uint site;
+};
+static std::deque<RequestSite> request_sites;
+
+// Descriptions of the call sites, indexed by RequestSite::site
+static std::vector<std::string> site_names{"unknown request"};
+
+// Sites normally get pruned as events show their requests succeeded,
+//  but that needn't happen if nothing comes back for a while
+#define MAX_REQUEST_SITES 4096
+
+uint intern_site(const char* what) {
+	for(uint i = 0; i < site_names.size(); ++i) {
+		if(site_names[i] == what) {
+			return i;
+		}
+	}
+	
+	site_names.push_back(what);
+	return site_names.size() - 1;
+}
+
+/**
+ * Record where an unchecked request was sent from.
+**/
+void track_request(
+	xcb_void_cookie_t cookie, frame_id_t owner, const char* what
+) {
+	if(request_sites.size() >= MAX_REQUEST_SITES) {
+		request_sites.pop_front();
+	}
+	
+	request_sites.push_back({cookie.sequence, owner, intern_site(what)});
+}
+
+/**
+ * Forget requests sent before the given sequence number. Errors come
+ *  back in order, so those can no longer fail.
+**/
+void prune_requests(uint sequence) {
+	while(
+		request_sites.size() &&
+		(int)(request_sites.front().sequence - sequence) < 0
+	) {
+		request_sites.pop_front();
+	}
+}
+
+const RequestSite* find_request(uint sequence) {
+	prune_requests(sequence);
+	
+	if(request_sites.size() && request_sites.front().sequence == sequence) {
+		return &request_sites.front();
+	}
+	return nullptr;
+}
+
+/**
+ * Describe an error delivered through the event queue.
+**/
+std::string describeError(
+	int code, int major, int minor, uint resource, uint site
+) {
+	xcb_generic_error_t error;
+	memset(&error, 0, sizeof(error));
+	
+	error.error_code = code;
+	error.major_code = major;
+	error.minor_code = minor;
+	error.resource_id = resource;
+	
+	auto& what = site_names[site < site_names.size()? site : 0];
+	return what + " failed (" + xcb_describeError(&error) + ")";
+}
+
 void init_xcb() {
 	conn = xcb_connect(nullptr, nullptr);
 	screen = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
+	root_visual = find_visual(screen->root_visual);
 	
 	auto* cookies = xcb_ewmh_init_atoms(conn, &ewmh);
 	xcb_generic_error_t* error;
@@ -113,19 +242,20 @@ void init_xcb() {
 	}
 	
 	init_keysym();
+	init_render();
 }
 
 event::mouse::Button xcb2satori_mousebutton(xcb_button_t code) {
 	switch(code) {
 		//case XCB_BUTTON_INDEX*: ?
 		
-		case 0: return event::mouse::LEFT;
-		case 1: return event::mouse::MIDDLE;
-		case 2: return event::mouse::RIGHT;
+		case 1: return event::mouse::LEFT;
+		case 2: return event::mouse::MIDDLE;
+		case 3: return event::mouse::RIGHT;
 		
-		// 3 and 4 shouldn't be given to this function.
-		case 3:
+		// 4 and 5 shouldn't be given to this function.
 		case 4:
+		case 5:
 			return event::mouse::UNKNOWN;
 	}
 	
@@ -151,60 +281,597 @@ int double_bits(int x) {
 	return x | (x << 1);
 }
 
+/**
+ * Scale an 8-bit channel to the bits of a visual's channel mask.
+**/
+uint scale_channel(uint c, uint mask) {
+	if(!mask) {
+		return 0;
+	}
+	
+	uint bits = __builtin_popcount(mask);
+	return ((c*((1<<bits) - 1) + 0x7f)/0xff) << __builtin_ctz(mask);
+}
+
+std::string describe_color(uint rgba) {
+	std::stringstream ss;
+	ss << "#" << std::hex << std::setfill('0') << std::setw(8) << rgba;
+	return ss.str();
+}
+
+// Pixels allocated on the connection, keyed by colormap and RGBA so
+//  every frame sharing a colormap shares its allocations
+static std::unordered_map<uint64_t, uint> color_cache;
+
+// What's using each allocated pixel, keyed by colormap and pixel. Close
+//  colors can get the same pixel, so the count is kept here, and the
+//  server is only left holding one allocation of it.
+struct PixelEntry {
+	std::vector<uint> colors;
+	uint refs;
+};
+static std::unordered_map<uint64_t, PixelEntry> color_pixels;
+
+inline uint64_t color_key(xcb_colormap_t cmap, uint v) {
+	return ((uint64_t)cmap<<32)|v;
+}
+
 struct RenderTarget {
 	xcb_colormap_t cmap;
+	xcb_visualtype_t* visual;
+	uint depth;
+	
+	// Where alpha goes in the pixels of ARGB visuals, 0 for the rest
+	uint alpha_mask = 0;
+	
+	// Whether cmap was made just for this target
+	bool owns_cmap = false;
+	
+	// XRender picture of the drawable last drawn to, made the first
+	//  time it's needed
+	xcb_render_picture_t picture = 0;
+	xcb_drawable_t picture_drawable = 0;
+	
+	// Clip for everything drawn to the target. GCs and the picture are
+	//  only brought up to date when they're used, by comparing the serial
+	//  they last had with clip_serial, which starts at 0 for no clip.
+	Region clip;
+	bool clipped = false;
+	uint clip_serial = 0, picture_clip = 0;
+	
+	/**
+	 * Clip drawing to a region, or stop clipping with nullptr.
+	**/
+	void setClip(const Region* r) {
+		if(!r && !clipped) {
+			return;
+		}
+		
+		clipped = r != nullptr;
+		clip = r? *r : Region();
+		++clip_serial;
+	}
+	
+	xcb_render_picture_t getPicture(xcb_drawable_t d) {
+		if(picture && picture_drawable != d) {
+			freePicture();
+		}
+		
+		if(!picture) {
+			auto format = visual_format(visual->visual_id);
+			if(!format) {
+				return 0;
+			}
+			
+			picture = xcb_generate_id(conn);
+			picture_drawable = d;
+			picture_clip = 0;
+			track_request(
+				xcb_render_create_picture(conn, picture, d, format, 0, 0),
+				d, "Picture creation"
+			);
+		}
+		
+		if(picture_clip != clip_serial) {
+			if(clipped) {
+				auto rects = clip.rects();
+				xcb_render_set_picture_clip_rectangles(
+					conn, picture, 0, 0, rects.size(), rects.data()
+				);
+			}
+			else {
+				uint none = XCB_NONE;
+				xcb_render_change_picture(
+					conn, picture, XCB_RENDER_CP_CLIP_MASK, &none
+				);
+			}
+			picture_clip = clip_serial;
+		}
+		return picture;
+	}
+	
+	void freePicture() {
+		if(picture) {
+			xcb_render_free_picture(conn, picture);
+			picture = 0;
+		}
+	}
 	
 	int maxColorMappings() {
 		return 1;
 	}
 	
-	uint allocColor(uint rgba) {
-		uint
-			r = rgba>>24,
-			g = (rgba>>16)&0xff,
-			b = (rgba>>8)&0xff,
-			a = rgba&0xff;
-		
-		// Alpha is ignored for now, see the XRender extension
-		auto cookie = xcb_alloc_color(
-			conn, cmap,
-			double_bits(r), double_bits(g), double_bits(b)
+	/**
+	 * Whether pixel values can be computed from the visual's masks
+	 *  rather than allocated by the server.
+	**/
+	bool isTrueColor() {
+		return visual && (
+			visual->_class == XCB_VISUAL_CLASS_TRUE_COLOR ||
+			visual->_class == XCB_VISUAL_CLASS_DIRECT_COLOR
 		);
+	}
+	
+	uint allocColor(uint rgba) {
+		return allocColors(std::vector<uint>{rgba})[0];
+	}
+	
+	/**
+	 * Allocate pixel values for several colors, sending every request
+	 *  before waiting on any of the replies.
+	**/
+	std::vector<uint> allocColors(const std::vector<uint>& rgba) {
+		std::vector<uint> pixels(rgba.size());
 		
-		xcb_generic_error_t* error;
-		auto reply = xcb_alloc_color_reply(conn, cookie, &error);
-		if(error) {
-			std::stringstream ss;
-			ss.width(2);
-			ss << "Allocation of color #" <<
-				std::hex << std::setfill('0') <<
-				std::setw(2) << r <<
-				std::setw(2) << g <<
-				std::setw(2) << b <<
-				std::setw(2) << a << " failed";
-			throw buildError(ss.str(), error);
+		if(isTrueColor()) {
+			for(uint i = 0; i < rgba.size(); ++i) {
+				uint c = rgba[i], a = 0xff;
+				
+				// ARGB visuals hold premultiplied alpha, anything else
+				//  drops it and leaves blending to RENDER
+				if(alpha_mask) {
+					a = c&0xff;
+					c = (convert::mul_div255(c>>24, a)<<24) |
+						(convert::mul_div255((c>>16)&0xff, a)<<16) |
+						(convert::mul_div255((c>>8)&0xff, a)<<8);
+				}
+				
+				pixels[i] =
+					scale_channel(c>>24, visual->red_mask) |
+					scale_channel((c>>16)&0xff, visual->green_mask) |
+					scale_channel((c>>8)&0xff, visual->blue_mask) |
+					scale_channel(a, alpha_mask);
+			}
+			return pixels;
+		}
+		
+		std::vector<uint> pending, got;
+		std::vector<xcb_alloc_color_cookie_t> cookies;
+		
+		for(uint i = 0; i < rgba.size(); ++i) {
+			auto it = color_cache.find(color_key(cmap, rgba[i]));
+			if(it != color_cache.end()) {
+				++color_pixels[color_key(cmap, it->second)].refs;
+				pixels[i] = it->second;
+				got.push_back(it->second);
+				continue;
+			}
+			
+			uint c = rgba[i];
+			pending.push_back(i);
+			cookies.push_back(xcb_alloc_color(
+				conn, cmap,
+				double_bits(c>>24),
+				double_bits((c>>16)&0xff),
+				double_bits((c>>8)&0xff)
+			));
+		}
+		
+		// Every reply has to be collected even if one fails
+		xcb_generic_error_t* failure = nullptr;
+		uint failed = 0;
+		
+		for(uint i = 0; i < pending.size(); ++i) {
+			uint c = rgba[pending[i]];
+			
+			xcb_generic_error_t* error;
+			auto* reply = xcb_alloc_color_reply(conn, cookies[i], &error);
+			if(error) {
+				if(failure) {
+					free(error);
+				}
+				else {
+					failure = error;
+					failed = c;
+				}
+				continue;
+			}
+			
+			uint pixel = reply->pixel;
+			free(reply);
+			
+			// A pixel already held gives back the extra allocation
+			auto& entry = color_pixels[color_key(cmap, pixel)];
+			if(entry.refs) {
+				xcb_free_colors(conn, cmap, 0, 1, &pixel);
+			}
+			auto& colors = entry.colors;
+			if(std::find(colors.begin(), colors.end(), c) == colors.end()) {
+				colors.push_back(c);
+			}
+			++entry.refs;
+			color_cache[color_key(cmap, c)] = pixel;
+			
+			pixels[pending[i]] = pixel;
+			got.push_back(pixel);
+		}
+		
+		// Nothing from a batch that failed is kept
+		if(failure) {
+			deallocColors(got);
+			
+			auto err = buildError(
+				"Allocation of color " + describe_color(failed) +
+					" failed",
+				failure
+			);
+			free(failure);
+			throw err;
+		}
+		
+		return pixels;
+	}
+	
+	/**
+	 * Free a private colormap along with everything cached for it.
+	**/
+	void freeColormap() {
+		for(auto it = color_cache.begin(); it != color_cache.end();) {
+			if(it->first>>32 == cmap) {
+				color_pixels.erase(color_key(cmap, it->second));
+				it = color_cache.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+		
+		xcb_free_colormap(conn, cmap);
+	}
+	
+	/**
+	 * The RGBA a pixel value was allocated for, or opaque black if it
+	 *  wasn't allocated through this target.
+	**/
+	uint pixelColor(uint pixel) {
+		if(isTrueColor()) {
+			uint a = 0xff, rgba = 0;
+			if(alpha_mask) {
+				uint max = alpha_mask>>__builtin_ctz(alpha_mask);
+				a = ((pixel&alpha_mask)>>__builtin_ctz(alpha_mask))*0xff/max;
+			}
+			
+			uint masks[] = {
+				visual->red_mask, visual->green_mask, visual->blue_mask
+			};
+			for(uint i = 0; i < 3; ++i) {
+				uint m = masks[i], max = m>>__builtin_ctz(m);
+				uint c = ((pixel&m)>>__builtin_ctz(m))*0xff/max;
+				
+				// Undo the premultiplication of ARGB visuals
+				if(alpha_mask) {
+					c = a? std::min(0xffu, (c*0xff + a/2)/a) : 0;
+				}
+				rgba |= c<<(24 - 8*i);
+			}
+			return rgba|a;
 		}
-		return reply->pixel;
+		
+		auto it = color_pixels.find(color_key(cmap, pixel));
+		return it == color_pixels.end()? 0xff : it->second.colors[0]|0xff;
+	}
+	
+	/**
+	 * The RGBA a style draws with, its foreground with the style's
+	 *  opacity.
+	**/
+	uint styleColor(const display::Style& style) {
+		return (pixelColor(style.fg)&~0xffu)|style.alpha;
 	}
 	
 	void deallocColors(const std::vector<uint>& ids) {
-		xcb_free_colors(conn, cmap, 0, ids.size(), ids.data());
+		// Computed pixels were never allocated
+		if(isTrueColor()) {
+			return;
+		}
+		
+		// Only release pixels nobody else is using
+		std::vector<uint> unused;
+		for(auto id : ids) {
+			auto pit = color_pixels.find(color_key(cmap, id));
+			if(pit == color_pixels.end()) {
+				continue;
+			}
+			
+			if(--pit->second.refs == 0) {
+				for(auto c : pit->second.colors) {
+					color_cache.erase(color_key(cmap, c));
+				}
+				color_pixels.erase(pit);
+				unused.push_back(id);
+			}
+		}
+		
+		if(unused.size()) {
+			xcb_free_colors(conn, cmap, 0, unused.size(), unused.data());
+		}
+	}
+};
+
+#define GC_POOL_SIZE 16
+
+/**
+ * Write the GC values which differ between two styles, returning their
+ *  mask. Values have to be listed in the order of their mask bits.
+**/
+int diff_gc_style(
+	const display::Style& from, const display::Style& to, int* cur
+) {
+	int mask = 0;
+	
+	#define DIFF(field, bit) \
+		if(from.field != to.field) { \
+			*(cur++) = to.field; \
+			mask |= bit; \
+		}
+	
+	DIFF(fg, XCB_GC_FOREGROUND);
+	DIFF(bg, XCB_GC_BACKGROUND);
+	DIFF(line_width, XCB_GC_LINE_WIDTH);
+	DIFF(line_style, XCB_GC_LINE_STYLE);
+	DIFF(cap_style, XCB_GC_CAP_STYLE);
+	DIFF(join_style, XCB_GC_JOIN_STYLE);
+	DIFF(fill_style, XCB_GC_FILL_STYLE);
+	// 0 leaves whatever font is there
+	if(to.font) {
+		DIFF(font, XCB_GC_FONT);
+	}
+	DIFF(clip_x, XCB_GC_CLIP_ORIGIN_X);
+	DIFF(clip_y, XCB_GC_CLIP_ORIGIN_Y);
+	DIFF(dash_offset, XCB_GC_DASH_OFFSET);
+	// Non-uniform dash patterns need their own request
+	if(from.dashes != to.dashes && to.dashes.size() == 1) {
+		*(cur++) = to.dashes[0];
+		mask |= XCB_GC_DASH_LIST;
+	}
+	DIFF(arc_mode, XCB_GC_ARC_MODE);
+	
+	#undef DIFF
+	
+	return mask;
+}
+
+/**
+ * Graphics contexts made for a drawable, each tagged with the state
+ *  it's in so draws with the same style share one server-side GC.
+ *  The least recently used is freed when the pool is full.
+**/
+struct GCPool {
+	struct Entry {
+		xcb_gcontext_t gc;
+		display::Style style;
+		uint64_t used;
+		// RenderTarget::clip_serial of the clip the GC has
+		uint clip;
+	};
+	
+	std::vector<Entry> entries;
+	uint64_t clock = 0;
+	
+	Entry* find(xcb_gcontext_t gc) {
+		for(auto& e : entries) {
+			if(e.gc == gc) {
+				return &e;
+			}
+		}
+		return nullptr;
+	}
+	
+	/**
+	 * Bring a GC's state from one style to another, sending only what
+	 *  differs.
+	**/
+	void restyle(
+		xcb_gcontext_t gc,
+		const display::Style& from, const display::Style& to
+	) {
+		int values[24];
+		int mask = diff_gc_style(from, to, values);
+		
+		if(mask) {
+			xcb_change_gc(conn, gc, mask, values);
+		}
+		if(from.dashes != to.dashes && to.dashes.size() > 1) {
+			xcb_set_dashes(
+				conn, gc, to.dash_offset, to.dashes.size(),
+				to.dashes.data()
+			);
+		}
+	}
+	
+	/**
+	 * Give a GC the target's current clip if it doesn't have it yet.
+	**/
+	xcb_gcontext_t clipped(RenderTarget& rt, Entry& e) {
+		if(e.clip == rt.clip_serial) {
+			return e.gc;
+		}
+		
+		if(rt.clipped) {
+			auto rects = rt.clip.rects();
+			xcb_set_clip_rectangles(
+				conn, XCB_CLIP_ORDERING_YX_BANDED, e.gc,
+				e.style.clip_x, e.style.clip_y, rects.size(), rects.data()
+			);
+		}
+		else {
+			uint none = XCB_NONE;
+			xcb_change_gc(conn, e.gc, XCB_GC_CLIP_MASK, &none);
+		}
+		e.clip = rt.clip_serial;
+		return e.gc;
+	}
+	
+	/**
+	 * Get a GC in the given style and the target's clip, preferring one
+	 *  already in that state, then restyling the one the caller last
+	 *  had, and only then making a new one.
+	**/
+	xcb_gcontext_t bind(
+		RenderTarget& rt, xcb_drawable_t target, xcb_gcontext_t current,
+		const display::Style& style
+	) {
+		++clock;
+		
+		auto* cur = find(current);
+		if(cur && cur->style == style) {
+			cur->used = clock;
+			return clipped(rt, *cur);
+		}
+		
+		for(auto& e : entries) {
+			if(e.style == style) {
+				e.used = clock;
+				return clipped(rt, e);
+			}
+		}
+		
+		if(cur) {
+			restyle(cur->gc, cur->style, style);
+			cur->style = style;
+			cur->used = clock;
+			return clipped(rt, *cur);
+		}
+		
+		if(entries.size() >= GC_POOL_SIZE) {
+			auto lru = entries.begin();
+			for(auto it = entries.begin(); it != entries.end(); ++it) {
+				if(it->used < lru->used) {
+					lru = it;
+				}
+			}
+			
+			xcb_free_gc(conn, lru->gc);
+			entries.erase(lru);
+		}
+		
+		// A new GC starts out in X's default state
+		display::Style defaults(0, 1, 0, 0);
+		int values[24];
+		
+		xcb_gcontext_t gc = xcb_generate_id(conn);
+		xcb_create_gc(
+			conn, gc, target,
+			diff_gc_style(defaults, style, values), values
+		);
+		if(style.dashes.size() > 1) {
+			restyle(gc, defaults, style);
+		}
+		
+		entries.push_back(Entry{gc, style, clock, 0});
+		return clipped(rt, entries.back());
+	}
+	
+	void clear() {
+		for(auto& e : entries) {
+			xcb_free_gc(conn, e.gc);
+		}
+		entries.clear();
 	}
 };
 
+#include "text.cc"
+#include "image.cc"
+#include "display-list.cc"
+
+void union_damage(event::window::Draw& into, const event::window::Draw& d) {
+	int
+		x2 = std::max(into.x + (int)into.w, d.x + (int)d.w),
+		y2 = std::max(into.y + (int)into.h, d.y + (int)d.h);
+	
+	into.x = std::min(into.x, d.x);
+	into.y = std::min(into.y, d.y);
+	into.w = x2 - into.x;
+	into.h = y2 - into.y;
+}
+
 struct Frame : public RenderTarget {
 	static std::set<Frame*> toflush;
+	static std::unordered_map<frame_id_t, Frame*> registry;
 	
 	xcb_window_t frame;
 	int event_mask;
 	bool visible;
 	
+	GCPool gcs;
+	
+	// The last drawing, and whether it's kept to answer exposures
+	//  without asking JS to draw again
+	DisplayList display_list;
+	bool retained = false;
+	xcb_gcontext_t replay_gc = 0;
+	
+	// Background pixel, kept here since buffered frames paint it
+	//  themselves
+	uint back_pixel;
+	
+	// Everything exposed or invalidated since JS last drew
+	Region damage;
+	
+	/**
+	 * Optional back buffer. Drawing goes to the pixmap, which is then
+	 *  copied to the window, so exposures can be answered without
+	 *  drawing again.
+	**/
+	struct BackBuffer {
+		xcb_pixmap_t pixmap = 0;
+		xcb_gcontext_t gc = 0;
+		uint w = 0, h = 0;
+		
+		// Whether the pixmap holds a complete drawing
+		bool valid = false;
+		
+		// What's been drawn since the last present
+		bool damaged = false;
+		event::window::Draw damage;
+	} back;
+	bool buffered = false;
+	
+	// Last geometry the server reported, kept up to date by its
+	//  ConfigureNotify events so reading it never needs a round trip
+	struct Geometry {
+		int x, y;
+		uint w, h, bw;
+	} geometry;
+	
+	// Geometry as of the last configure request, which is what reads
+	//  see until the server has answered all of them
+	Geometry wanted;
+	uint configuring = 0;
+	
 	struct ConfigureCache {
 		Dirty<int> x, y;
 		Dirty<uint> w, h, bw;
 		
 		void flush(Frame* self) {
 			int values[7], *cur = &values[0], mask = 0;
+			auto& want = self->wanted;
+			
+			if(x.dirty) want.x = x.value;
+			if(y.dirty) want.y = y.value;
+			if(w.dirty) want.w = w.value;
+			if(h.dirty) want.h = h.value;
+			if(bw.dirty) want.bw = bw.value;
 			
 			x.clean(mask, cur, XCB_CONFIG_WINDOW_X);
 			y.clean(mask, cur, XCB_CONFIG_WINDOW_Y);
@@ -214,6 +881,7 @@ struct Frame : public RenderTarget {
 			
 			if(mask) {
 				xcb_configure_window(conn, self->frame, mask, values);
+				++self->configuring;
 			}
 		}
 	} configure_cache;
@@ -254,7 +922,15 @@ struct Frame : public RenderTarget {
 	static void init() {
 	}
 	
-	Frame(frame_id_t parent, int x, int y, uint w, uint h, uint bw, color_id_t bg) {
+	/**
+	 * argb asks for a 32-bit visual with alpha, so a compositing
+	 *  manager can blend the frame with whatever is behind it. Children
+	 *  always share their parent's visual.
+	**/
+	Frame(
+		frame_id_t parent, int x, int y, uint w, uint h, uint bw,
+		color_id_t bg, bool argb
+	) {
 		if(!conn) {
 			init_xcb();
 		}
@@ -263,57 +939,99 @@ struct Frame : public RenderTarget {
 			parent = screen->root;
 		}
 		
-		event_mask = 0;
+		// Structure notifications keep the geometry cache up to date
+		event_mask = XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+		
+		Frame* pframe = lookup(parent);
+		if(pframe) {
+			visual = pframe->visual;
+			depth = pframe->depth;
+			alpha_mask = pframe->alpha_mask;
+		}
+		else if(argb && argb_visual) {
+			visual = find_visual(argb_visual);
+			depth = 32;
+			alpha_mask = 0xff000000;
+		}
+		else {
+			visual = root_visual;
+			depth = screen->root_depth;
+		}
+		
+		useColormap(pframe);
 		
 		int mask = 0;
 		int values[WIN_ATTR_LEN], *cur = &values[0];
 		
 		if(bg == 0) {
-			bg = screen->white_pixel;
+			bg = alpha_mask? allocColor(0xffffffff) : screen->white_pixel;
 		}
+		back_pixel = bg;
 		
 		if(bg) {
 			mask |= XCB_CW_BACK_PIXEL;
 			*(cur++) = bg;
 		}
 		
+		// Without a border pixel the border would be copied from the
+		//  parent, which can't be done across depths
+		if(visual != root_visual) {
+			mask |= XCB_CW_BORDER_PIXEL;
+			*(cur++) = 0;
+		}
+		
 		mask |= XCB_CW_EVENT_MASK;
 		*(cur++) = event_mask;
 		
+		if(owns_cmap) {
+			mask |= XCB_CW_COLORMAP;
+			*(cur++) = cmap;
+		}
+		
 		// Gives weird behavior with 0 sizes
 		if(w < 1) w = 1;
 		if(h < 1) h = 1;
 		
 		frame = xcb_generate_id(conn);
+		geometry = wanted = Geometry{x, y, w, h, bw};
+		registry[frame] = this;
 		
-		auto cookie = xcb_create_window(
-			conn, XCB_COPY_FROM_PARENT, frame, parent,
+		track_request(xcb_create_window(
+			conn, depth, frame, parent,
 			// x, y, w, h (ignore for now)
 			x, y, w, h, bw,
 			XCB_WINDOW_CLASS_INPUT_OUTPUT,
-			screen->root_visual,
+			visual->visual_id,
 			
 			mask, values
-		);
+		), frame, "Frame creation");
 		visible = false;
-		
-		auto* error = xcb_request_check(conn, cookie);
-		if(error) {
-			throw buildError("Frame creation failed", error);
+	}
+	
+	/**
+	 * Pick the colormap for the frame's visual. A window tree shares
+	 *  its colormap, and the screen's default one works for anything
+	 *  using the root visual, so a private colormap is only made when
+	 *  the visual needs one.
+	**/
+	void useColormap(Frame* parent) {
+		if(parent && parent->visual == visual) {
+			cmap = parent->cmap;
+			owns_cmap = false;
 		}
-		
-		cmap = xcb_generate_id(conn);
-		cookie = xcb_create_colormap(
-			conn, XCB_COLORMAP_ALLOC_NONE,
-			cmap, frame, screen->root_visual
-		);
-		
-		error = xcb_request_check(conn, cookie);
-		if(error) {
-			throw buildError("Colormap allocation failed", error);
+		else if(visual->visual_id == screen->root_visual) {
+			cmap = screen->default_colormap;
+			owns_cmap = false;
+		}
+		else {
+			cmap = xcb_generate_id(conn);
+			owns_cmap = true;
+			
+			xcb_create_colormap(
+				conn, XCB_COLORMAP_ALLOC_NONE,
+				cmap, screen->root, visual->visual_id
+			);
 		}
-		
-		xcb_flush(conn);
 	}
 	
 	~Frame() {
@@ -334,16 +1052,35 @@ struct Frame : public RenderTarget {
 		return frame;
 	}
 	
+	static Frame* lookup(frame_id_t id) {
+		auto it = registry.find(id);
+		return it == registry.end()? nullptr : it->second;
+	}
+	
 	void close() {
 		if(frame) {
+			gcs.clear();
+			freePicture();
+			freeBack();
 			xcb_destroy_window(conn, frame);
+			registry.erase(frame);
 			frame = 0;
+			
+			if(owns_cmap) {
+				freeColormap();
+				owns_cmap = false;
+			}
 		}
 	}
 	
 	void setBG(color_id_t bg) {
-		attribute_cache.back_color.set(bg);
-		toflush.insert(this);
+		back_pixel = bg;
+		
+		// Buffered frames have no window background
+		if(!buffered) {
+			attribute_cache.back_color.set(bg);
+			toflush.insert(this);
+		}
 	}
 	
 	bool getVisible() {
@@ -359,14 +1096,12 @@ struct Frame : public RenderTarget {
 	}
 	
 	int getPosition() {
-		auto cookie = xcb_get_geometry(conn, frame);
-		xcb_generic_error_t* error;
-		auto reply = xcb_get_geometry_reply(conn, cookie, &error);
-		if(error) {
-			throw buildError("Frame.getPosition()", error);
-		}
+		auto& cc = configure_cache;
+		int
+			x = cc.x.dirty? cc.x.value : wanted.x,
+			y = cc.y.dirty? cc.y.value : wanted.y;
 		
-		return (reply->x<<16)|reply->y;
+		return (x<<16)|(y&0xffff);
 	}
 	void setPosition(int p) {
 		configure_cache.x.set(p>>16);
@@ -375,14 +1110,12 @@ struct Frame : public RenderTarget {
 	}
 	
 	uint getSize() {
-		auto cookie = xcb_get_geometry(conn, frame);
-		xcb_generic_error_t* error;
-		auto reply = xcb_get_geometry_reply(conn, cookie, &error);
-		if(error) {
-			throw buildError("Frame.getSize()", error);
-		}
+		auto& cc = configure_cache;
+		uint
+			w = cc.w.dirty? cc.w.value : wanted.w,
+			h = cc.h.dirty? cc.h.value : wanted.h;
 		
-		return (reply->width<<16)|reply->height;
+		return (w<<16)|h;
 	}
 	void setSize(int s) {
 		configure_cache.w.set(s>>16);
@@ -434,7 +1167,7 @@ struct Frame : public RenderTarget {
 			
 			case event::WINDOW_MOVE:
 			case event::WINDOW_RESIZE:
-				event_mask |= XCB_EVENT_MASK_PROPERTY_CHANGE;
+				event_mask |= XCB_EVENT_MASK_STRUCTURE_NOTIFY;
 				break;
 			case event::WINDOW_FOCUS:
 				event_mask |= XCB_EVENT_MASK_FOCUS_CHANGE;
@@ -451,6 +1184,8 @@ struct Frame : public RenderTarget {
 				//event_mask |= XCB_EVENT_MASK_DESTROY_NOTIFY;
 				break;
 			
+			// Errors are always delivered
+			case event::ERROR:
 			case event::UNKNOWN:
 				return;
 		}
@@ -464,172 +1199,459 @@ struct Frame : public RenderTarget {
 		}
 	}
 	
-	void redraw() {
-		int size = getSize();
-		xcb_clear_area(conn, 1, frame, 0, 0, size>>16, size&0xffff);
+	/**
+	 * Answer an exposure by sending the retained drawing again, over
+	 *  just the damage.
+	**/
+	void replay() {
+		setClip(&damage);
+		display_list.submit(*this, frame, gcs, replay_gc);
+		setClip(nullptr);
+		damage.clear();
 	}
-};
-std::set<Frame*> Frame::toflush;
-
-int build_gc_style(display::Style style, int* cur) {
-	int mask = 0;
 	
-	if(style.fg) {
-		*(cur++) = style.fg;
-		mask |= XCB_GC_FOREGROUND;
+	/**
+	 * Hand the damage over to be drawn, leaving none behind.
+	**/
+	void takeDamage(Region& out) {
+		out.boxes.swap(damage.boxes);
+		damage.clear();
 	}
-	if(style.bg) {
-		*(cur++) = style.bg;
-		mask |= XCB_GC_BACKGROUND;
+	
+	/**
+	 * Turn the back buffer on or off. While it's on the window has no
+	 *  background, so the server doesn't clear what's about to be
+	 *  copied over anyway.
+	**/
+	void setBuffered(bool on) {
+		if(on == buffered) {
+			return;
+		}
+		buffered = on;
+		
+		uint value;
+		if(on) {
+			value = XCB_BACK_PIXMAP_NONE;
+			xcb_change_window_attributes(
+				conn, frame, XCB_CW_BACK_PIXMAP, &value
+			);
+		}
+		else {
+			freeBack();
+			
+			value = back_pixel;
+			xcb_change_window_attributes(
+				conn, frame, XCB_CW_BACK_PIXEL, &value
+			);
+		}
 	}
-	if(style.line_width != -1) {
-		*(cur++) = style.line_width;
-		mask |= XCB_GC_LINE_WIDTH;
+	
+	/**
+	 * The drawable GraphicsContexts should draw to.
+	**/
+	xcb_drawable_t drawable() {
+		return buffered? ensureBack() : frame;
 	}
-	if(style.font) {
-		*(cur++) = style.font;
-		mask |= XCB_GC_FONT;
+	
+	/**
+	 * Make sure the back buffer covers the window, reallocating it if
+	 *  the window grew. A new buffer starts out filled with the
+	 *  background and needs a full draw. A size still being configured
+	 *  is covered too, since JS draws for it right away.
+	**/
+	xcb_pixmap_t ensureBack() {
+		uint
+			w = std::max(geometry.w, wanted.w),
+			h = std::max(geometry.h, wanted.h);
+		
+		if(back.pixmap && back.w >= w && back.h >= h) {
+			return back.pixmap;
+		}
+		
+		if(back.pixmap) {
+			xcb_free_pixmap(conn, back.pixmap);
+		}
+		else {
+			uint no_exposures = 0;
+			back.gc = xcb_generate_id(conn);
+			xcb_create_gc(
+				conn, back.gc, frame,
+				XCB_GC_GRAPHICS_EXPOSURES, &no_exposures
+			);
+		}
+		
+		back.pixmap = xcb_generate_id(conn);
+		back.w = w;
+		back.h = h;
+		track_request(xcb_create_pixmap(
+			conn, depth, back.pixmap, frame, w, h
+		), frame, "Back buffer creation");
+		
+		clearBack();
+		return back.pixmap;
 	}
 	
-	return mask;
-}
-
-struct GraphicsContext {
-	static std::set<GraphicsContext*> toflush;
+	void clearBack() {
+		xcb_change_gc(conn, back.gc, XCB_GC_FOREGROUND, &back_pixel);
+		
+		xcb_rectangle_t all{0, 0, (uint16_t)back.w, (uint16_t)back.h};
+		xcb_poly_fill_rectangle(conn, back.pixmap, back.gc, 1, &all);
+		
+		back.valid = false;
+		damageBack(event::window::Draw{0, 0, back.w, back.h, 0});
+		damage.unite(Region(0, 0, back.w, back.h));
+	}
 	
-	xcb_gcontext_t gc;
-	xcb_drawable_t target;
+	void freeBack() {
+		if(back.pixmap) {
+			xcb_free_pixmap(conn, back.pixmap);
+			xcb_free_gc(conn, back.gc);
+		}
+		back = BackBuffer();
+	}
+	
+	/**
+	 * Note an area of the back buffer that's about to be redrawn, so
+	 *  present() knows what to copy.
+	**/
+	void damageBack(const event::window::Draw& d) {
+		if(back.damaged) {
+			union_damage(back.damage, d);
+		}
+		else {
+			back.damage = d;
+			back.damaged = true;
+		}
+	}
 	
-	struct StyleCache {
-		//foreground
-		//background
+	/**
+	 * Copy what was drawn since the last present to the window.
+	**/
+	void present() {
+		if(!back.pixmap) {
+			return;
+		}
 		
-		Dirty<color_id_t> fg, bg;
-		Dirty<uint> lw;
+		auto& d = back.damage;
+		if(!back.damaged) {
+			d = event::window::Draw{0, 0, geometry.w, geometry.h, 0};
+		}
 		
-		//line width
-		//line style
-		//cap style
-		//join style
-		//fill style
-		//fill rule
-		//tile
-		//stipple
-		//stipple origin x
-		//stipple origin y
+		xcb_copy_area(
+			conn, back.pixmap, frame, back.gc,
+			d.x, d.y, d.x, d.y, d.w, d.h
+		);
 		
-		Dirty<font_id_t> font;
+		back.damaged = false;
+		back.valid = true;
+	}
+	
+	/**
+	 * Answer an exposure from the back buffer if it has a complete
+	 *  drawing for the whole window, taking the exposed area out of the
+	 *  damage. While a redraw is pending the buffer has been cleared
+	 *  for it, so JS has to draw first.
+	**/
+	bool exposeFromBack(const event::window::Draw& d) {
+		if(
+			!back.valid || back.damaged || !back.pixmap ||
+			back.w < geometry.w || back.h < geometry.h
+		) {
+			return false;
+		}
 		
-		//subwindow mode
-		//graphics exposure
-		//clip origin x
-		//clip origin y
-		//clip mask
-		//dash offset
-		//dash list
-		//arc mode
+		xcb_copy_area(
+			conn, back.pixmap, frame, back.gc,
+			d.x, d.y, d.x, d.y, d.w, d.h
+		);
+		damage.subtract(Region(d.x, d.y, d.w, d.h));
+		return true;
+	}
+	
+	void redraw() {
+		uint size = getSize();
+		redrawArea(0, 0, size>>16, size&0xffff);
+	}
+	
+	/**
+	 * Ask for part of the frame to be drawn again, leaving the rest of
+	 *  it alone.
+	**/
+	void redrawArea(int x, int y, uint w, uint h) {
+		if(!w || !h) {
+			return;
+		}
 		
-		void flush(GraphicsContext* self) {
-			int values[24], *cur = &values[0], mask = 0;
+		// Whatever was retained is out of date now
+		retained = false;
+		
+		// Buffered frames are drawn straight away with no clear or
+		//  expose round trip
+		if(buffered) {
+			ensureBack();
+			
+			xcb_change_gc(conn, back.gc, XCB_GC_FOREGROUND, &back_pixel);
+			xcb_rectangle_t area{
+				(int16_t)x, (int16_t)y, (uint16_t)w, (uint16_t)h
+			};
+			xcb_poly_fill_rectangle(conn, back.pixmap, back.gc, 1, &area);
+			
+			event::window::Draw draw{x, y, w, h, 0};
+			damageBack(draw);
+			damage.unite(Region(x, y, w, h));
 			
-			fg.clean(mask, cur, XCB_GC_FOREGROUND);
-			bg.clean(mask, cur, XCB_GC_BACKGROUND);
-			lw.clean(mask, cur, XCB_GC_LINE_WIDTH);
-			font.clean(mask, cur, XCB_GC_FONT);
+			// Fold into a draw already waiting for JS, the way
+			//  exposures are, so repeated invalidations draw once
+			for(auto& q : event_queue) {
+				if(q.code == event::WINDOW_DRAW && q.target == frame) {
+					union_damage(q.window.draw, draw);
+					return;
+				}
+			}
 			
-			xcb_create_gc(conn, self->gc, self->target, mask, values);
+			event::Any ev;
+			memset(&ev, 0, sizeof(ev));
+			ev.code = event::WINDOW_DRAW;
+			ev.target = frame;
+			ev.window.draw = draw;
+			event_queue.push_back(ev);
+			return;
 		}
-	} style_cache;
+		
+		// The exposure this generates adds the damage
+		xcb_clear_area(conn, 1, frame, x, y, w, h);
+	}
+};
+std::set<Frame*> Frame::toflush;
+std::unordered_map<frame_id_t, Frame*> Frame::registry;
+
+struct GraphicsContext {
+	Frame* frame;
+	xcb_gcontext_t gc;
+	xcb_drawable_t target;
 	
-	static void init() {
+	// The style draws should use. The GC it's drawn with comes from
+	//  the frame's pool right before drawing.
+	display::Style style;
 	
-	}
+	static void init() {
 	
-	//GraphicsContext(target, fg, bg, lw, ls, cap, join, fill_style, fill_rule, font, clip, ...)
-	GraphicsContext(Frame* w, display::Style style) {
-		gc = xcb_generate_id(conn);
-		target = w->frame;
-		
-		int values[GC_STYLE_LEN];
-		xcb_create_gc(
-			conn, gc, target, build_gc_style(style, values), values
-		);
 	}
 	
-	~GraphicsContext() {
-		toflush.erase(this);
+	GraphicsContext(Frame* w, display::Style style):
+		frame(w), gc(0), target(w->drawable()), style(style) {
+		// -1 means unset, which is X's default of 0
+		if(this->style.line_width < 0) {
+			this->style.line_width = 0;
+		}
 	}
 	
-	void flush() {
-		style_cache.flush(this);
+	/**
+	 * Drawing has to see any style changes made before it.
+	**/
+	void applyStyle() {
+		gc = frame->gcs.bind(*frame, target, gc, style);
 	}
 	
 	void setFG(color_id_t fg) {
-		style_cache.fg.set(fg);
-		toflush.insert(this);
+		style.fg = fg;
+	}
+	void setAlpha(uint alpha) {
+		style.alpha = std::min(alpha, 0xffu);
 	}
 	void setBG(color_id_t bg) {
-		style_cache.bg.set(bg);
-		toflush.insert(this);
+		style.bg = bg;
 	}
 	void setLineWidth(uint lw) {
-		style_cache.lw.set(lw);
-		toflush.insert(this);
+		style.line_width = lw;
 	}
 	void setFont(font_id_t font) {
-		style_cache.font.set(font);
-		toflush.insert(this);
+		style.font = font;
+	}
+	
+	void setLineStyle(uint ls) {
+		style.line_style = ls;
+	}
+	void setCapStyle(uint cs) {
+		style.cap_style = cs;
+	}
+	void setJoinStyle(uint js) {
+		style.join_style = js;
+	}
+	void setFillStyle(uint fs) {
+		style.fill_style = fs;
+	}
+	void setClipOrigin(int x, int y) {
+		style.clip_x = x;
+		style.clip_y = y;
+	}
+	void setArcMode(uint mode) {
+		style.arc_mode = mode;
 	}
 	
+	/**
+	 * Set the lengths of alternating dashes and gaps. X has no empty
+	 *  dash list, so no dashes at all means solid lines.
+	**/
+	void setDashes(uint offset, const std::vector<uint8_t>& dashes) {
+		if(dashes.empty()) {
+			style.line_style = XCB_LINE_STYLE_SOLID;
+			return;
+		}
+		
+		style.dash_offset = offset;
+		style.dashes = dashes;
+	}
+	
+	/**
+	 * Clip drawing to a region, usually the damage being repainted, or
+	 *  stop clipping with nullptr. The clip belongs to the frame, so it
+	 *  also applies to recorded draws when they're submitted.
+	**/
+	void setClip(const Region* r) {
+		frame->setClip(r);
+	}
+	
+	// Where draws go between record() and submit()
+	DisplayList* recording = nullptr;
+	
+	/**
+	 * Start recording draws into the frame's display list instead of
+	 *  sending them.
+	**/
+	void record() {
+		frame->display_list.clear();
+		frame->retained = false;
+		recording = &frame->display_list;
+	}
+	
+	/**
+	 * Send everything recorded since record(), optionally keeping it to
+	 *  answer later exposures natively.
+	**/
+	void submit(bool retain) {
+		if(!recording) {
+			return;
+		}
+		
+		recording->submit(*frame, target, frame->gcs, gc);
+		frame->retained = retain;
+		if(!retain) {
+			recording->clear();
+		}
+		recording = nullptr;
+		
+		if(target != frame->frame) {
+			frame->present();
+		}
+	}
+	
+	void drawPoints(bool rel, const xcb_point_t* points, uint n) {
+		if(recording) {
+			recording->record(rel, style, points, n);
+			return;
+		}
+		
+		applyStyle();
+		DisplayList::draw(
+			*frame, rel? DisplayList::POINTS_REL : DisplayList::POINTS,
+			target, gc, style, points, n
+		);
+	}
 	void drawPoints(bool rel, const std::vector<display::Point>& points) {
 		std::vector<xcb_point_t> xpoints(points.size());
-		auto cur = xpoints.begin();
 		
-		for(uint i = 0; i < xpoints.size(); ++i) {
-			cur->x = points[i].x;
-			cur->y = points[i].y;
-			++cur;
+		for(uint i = 0; i < points.size(); ++i) {
+			xpoints[i].x = points[i].x;
+			xpoints[i].y = points[i].y;
 		}
 		
-		xcb_poly_point(conn,
-			rel? XCB_COORD_MODE_PREVIOUS : XCB_COORD_MODE_ORIGIN,
-			target, gc, xpoints.size(), xpoints.data()
-		);
+		drawPoints(rel, xpoints.data(), xpoints.size());
 	}
 	
+	void drawSegments(const xcb_segment_t* segments, uint n) {
+		if(recording) {
+			recording->record(style, segments, n);
+			return;
+		}
+		
+		applyStyle();
+		DisplayList::draw(
+			*frame, DisplayList::SEGMENTS, target, gc, style, segments, n
+		);
+	}
+	/**
+	 * Lines are independent of each other, so rel makes each line's
+	 *  end relative to its own start.
+	**/
+	void drawLines(bool rel, const xcb_segment_t* lines, uint n) {
+		if(!rel) {
+			drawSegments(lines, n);
+			return;
+		}
+		
+		std::vector<xcb_segment_t> segments(lines, lines + n);
+		for(auto& seg : segments) {
+			seg.x2 += seg.x1;
+			seg.y2 += seg.y1;
+		}
+		
+		drawSegments(segments.data(), segments.size());
+	}
 	void drawLines(bool rel, const std::vector<display::Line>& lines) {
-		std::vector<xcb_point_t> points(2*lines.size());
-		auto cur = points.begin();
+		std::vector<xcb_segment_t> segments(lines.size());
 		
 		for(uint i = 0; i < lines.size(); ++i) {
-			cur->x = lines[i].x1;
-			cur->y = lines[i].y1;
-			++cur;
-			cur->x = lines[i].x2;
-			cur->y = lines[i].y2;
-			++cur;
+			auto& line = lines[i];
+			auto& seg = segments[i];
+			
+			seg.x1 = line.x1;
+			seg.y1 = line.y1;
+			seg.x2 = rel? line.x1 + line.x2 : line.x2;
+			seg.y2 = rel? line.y1 + line.y2 : line.y2;
 		}
 		
-		xcb_poly_line(conn, 
-			rel? XCB_COORD_MODE_PREVIOUS : XCB_COORD_MODE_ORIGIN,
-			target, gc, 2*points.size(), points.data()
-		);
+		drawSegments(segments.data(), segments.size());
 	}
 	
+	void drawRects(bool fill, const xcb_rectangle_t* rects, uint n) {
+		if(recording) {
+			recording->record(fill, style, rects, n);
+			return;
+		}
+		
+		applyStyle();
+		DisplayList::draw(
+			*frame, fill? DisplayList::FILL_RECTS : DisplayList::RECTS,
+			target, gc, style, rects, n
+		);
+	}
 	void drawRects(bool fill, const std::vector<display::Rect>& rects) {
 		std::vector<xcb_rectangle_t> xrects(rects.size());
-		auto cur = xrects.begin();
 		
-		for(uint i = 0; i < xrects.size(); ++i) {
-			cur->x = rects[i].x;
-			cur->y = rects[i].y;
-			cur->width = rects[i].w;
-			cur->height = rects[i].h;
+		for(uint i = 0; i < rects.size(); ++i) {
+			xrects[i].x = rects[i].x;
+			xrects[i].y = rects[i].y;
+			xrects[i].width = rects[i].w;
+			xrects[i].height = rects[i].h;
 		}
 		
-		(fill? xcb_poly_fill_rectangle : xcb_poly_rectangle)(
-			conn, target, gc, xrects.size(), xrects.data()
-		);
+		drawRects(fill, xrects.data(), xrects.size());
+	}
+	
+	/**
+	 * Copy part of an image to the target at dx, dy.
+	**/
+	void putImage(
+		Image& image, int sx, int sy, int dx, int dy, uint w, uint h
+	) {
+		if(recording) {
+			recording->record(style, &image, sx, sy, dx, dy, w, h);
+			return;
+		}
+		
+		applyStyle();
+		image.put(*frame, target, gc, sx, sy, dx, dy, w, h, style.alpha);
 	}
 	
 	void drawOvals(bool fill, std::vector<display::Ellipse>& ellipses) {
@@ -643,56 +1665,351 @@ struct GraphicsContext {
 	}
 	
 	void drawText(int x, int y, const std::string& text) {
-		/*
-		 * TODO: This uses the old API, we want to use Xft
-		 */
-		printf("Target: %d, GC: %d\n", target, gc);
-		auto cookie = xcb_image_text_8_checked(
-			conn, text.size(), target, gc,
-			x, y, text.c_str()
-		);
-		
-		auto* error = xcb_request_check(conn, cookie);
-		if(error) {
-			throw buildError("Frame.drawText()", error);
+		if(recording) {
+			recording->record(style, x, y, text);
+			return;
 		}
+		
+		applyStyle();
+		draw_text(
+			*frame, target, gc, style, x, y, text.c_str(), text.size()
+		);
 	}
 };
-std::set<GraphicsContext*> GraphicsContext::toflush;
 
+/**
+ * Open a font and cache its metrics. The query goes out right behind
+ *  the open, so it's one round trip either way.
+**/
 uint openFont(const std::string& name) {
+	if(!conn) {
+		init_xcb();
+	}
+	
 	uint id = xcb_generate_id(conn);
-	auto cookie = xcb_open_font_checked(conn, id, name.size(), name.c_str());
 	
-	auto* error = xcb_request_check(conn, cookie);
+	auto open = xcb_open_font_checked(conn, id, name.size(), name.c_str());
+	auto query = xcb_query_font(conn, id);
+	
+	xcb_generic_error_t* error = xcb_request_check(conn, open);
 	if(error) {
-		throw buildError("openFont()", error);
+		xcb_discard_reply(conn, query.sequence);
+		
+		auto err = buildError(
+			"Opening font \"" + name + "\" failed", error
+		);
+		free(error);
+		throw err;
 	}
+	
+	auto* reply = xcb_query_font_reply(conn, query, &error);
+	if(error) {
+		auto err = buildError("Querying font failed", error);
+		free(error);
+		throw err;
+	}
+	
+	add_glyph_font(id, reply);
+	free(reply);
+	
 	return id;
 }
 
+// A font from openFonts() whose metrics haven't been collected yet
+struct PendingFont {
+	uint id;
+	std::string name;
+	
+	xcb_void_cookie_t open;
+	xcb_query_font_cookie_t query;
+	
+	xcb_query_font_reply_t* reply;
+	xcb_generic_error_t* error;
+	bool done;
+	
+	/**
+	 * Whether the query has been answered, without blocking.
+	**/
+	bool poll() {
+		if(!done) {
+			done = xcb_poll_for_reply(
+				conn, query.sequence, (void**)&reply, &error
+			);
+		}
+		return done;
+	}
+};
+
+// Replies come back in order, so only the front ever needs polling
+static std::deque<PendingFont> pending_fonts;
+
+/**
+ * Open several fonts without waiting on any of them. Their metrics are
+ *  collected by pollFont() as the replies come in.
+**/
+std::vector<uint> openFonts(const std::vector<std::string>& names) {
+	if(!conn) {
+		init_xcb();
+	}
+	
+	std::vector<uint> ids(names.size());
+	
+	for(uint i = 0; i < names.size(); ++i) {
+		auto& name = names[i];
+		uint id = ids[i] = xcb_generate_id(conn);
+		
+		auto open = xcb_open_font_checked(
+			conn, id, name.size(), name.c_str()
+		);
+		auto query = xcb_query_font(conn, id);
+		
+		pending_fonts.push_back(
+			PendingFont{id, name, open, query, nullptr, nullptr, false}
+		);
+	}
+	
+	return ids;
+}
+
+bool fontsReady() {
+	return pending_fonts.size() && pending_fonts.front().poll();
+}
+
+/**
+ * Finish the next font from openFonts() if its reply is in. error is
+ *  set if the font couldn't be opened.
+**/
+bool pollFont(uint& id, std::string& error) {
+	if(!fontsReady()) {
+		return false;
+	}
+	
+	auto pf = pending_fonts.front();
+	pending_fonts.pop_front();
+	id = pf.id;
+	
+	// The query came after the open, so this doesn't block
+	xcb_generic_error_t* failure = xcb_request_check(conn, pf.open);
+	if(failure) {
+		error = "Opening font \"" + pf.name + "\" failed (" +
+			xcb_describeError(failure) + ")";
+		free(failure);
+	}
+	else if(pf.error) {
+		error = "Querying font \"" + pf.name + "\" failed (" +
+			xcb_describeError(pf.error) + ")";
+	}
+	else {
+		add_glyph_font(id, pf.reply);
+	}
+	
+	free(pf.error);
+	free(pf.reply);
+	return true;
+}
+
+int measureText(xcb_font_t font, const std::string& text) {
+	return measure_text(font, text.c_str(), text.size());
+}
+
+/**
+ * Ascent and descent of a font, packed as in getSize().
+**/
+uint fontExtents(xcb_font_t font) {
+	auto& gf = glyph_font(font);
+	return (gf.ascent<<16)|(gf.descent&0xffff);
+}
+
 void closeFont(xcb_font_t font) {
+	forget_glyph_font(font);
 	xcb_close_font(conn, font);
 }
+
+/**
+ * The file descriptor of the X connection, which becomes readable
+ *  whenever the server sends us something.
+**/
+int connectionFD() {
+	if(!conn) {
+		init_xcb();
+	}
 	
-bool pollEvent(event::Any* ev) {
-	xcb_generic_event_t* xcb_ev = xcb_poll_for_event(conn);
+	return xcb_get_file_descriptor(conn);
+}
+
+/**
+ * Why the X connection failed, or nullptr if it's still good. A broken
+ *  connection stays readable forever, so this has to be checked.
+**/
+const char* connectionError() {
+	switch(conn? xcb_connection_has_error(conn) : 0) {
+		case 0: return nullptr;
+		case XCB_CONN_ERROR: return "X connection lost";
+		case XCB_CONN_CLOSED_EXT_NOTSUPPORTED:
+			return "X extension not supported";
+		case XCB_CONN_CLOSED_MEM_INSUFFICIENT: return "out of memory";
+		case XCB_CONN_CLOSED_REQ_LEN_EXCEED:
+			return "X request length exceeded";
+		default: return "X connection closed";
+	}
+}
+
+/**
+ * Whether events have already been read off the socket, eg while
+ *  waiting on a reply. These won't make the file descriptor readable,
+ *  so they have to be checked for before blocking on it.
+**/
+bool eventsQueued() {
+	// Font replies read along with other things count too, since
+	//  nothing else would get them collected
+	if(!event_queue.empty() || fontsReady()) {
+		return true;
+	}
 	
-	if(!xcb_ev) {
-		return false;
+	if(!peeked_event) {
+		peeked_event = xcb_poll_for_queued_event(conn);
+	}
+	
+	return peeked_event != nullptr;
+}
+
+xcb_generic_event_t* next_event() {
+	if(peeked_event) {
+		auto* xcb_ev = peeked_event;
+		peeked_event = nullptr;
+		return xcb_ev;
+	}
+	
+	return xcb_poll_for_event(conn);
+}
+	
+/**
+ * Input events report the innermost window they apply to first.
+**/
+frame_id_t pick_target(
+	xcb_window_t child, xcb_window_t event, xcb_window_t root
+) {
+	return child? child : event? event : root;
+}
+
+/**
+ * Move a position relative to the event window into the target's
+ *  space. A child target is a direct child of the event window, so its
+ *  cached geometry is enough.
+**/
+void target_coords(frame_id_t target, xcb_window_t event, int& x, int& y) {
+	if(target == event) {
+		return;
+	}
+	
+	if(auto* f = Frame::lookup(target)) {
+		x -= f->geometry.x + (int)f->geometry.bw;
+		y -= f->geometry.y + (int)f->geometry.bw;
+	}
+}
+
+/**
+ * Reconcile the geometry cache with the server, filling evs with a
+ *  resize and/or move event for whatever actually changed. Our own
+ *  configure requests only take effect here, so they're reported the
+ *  same as changes made by anyone else.
+**/
+uint configure_notify(xcb_configure_notify_event_t* xev, event::Any* evs) {
+	auto* f = Frame::lookup(xev->window);
+	if(!f) {
+		return 0;
+	}
+	
+	auto& geom = f->geometry;
+	uint n = 0;
+	
+	if(geom.w != xev->width || geom.h != xev->height) {
+		evs[n].code = event::WINDOW_RESIZE;
+		evs[n].target = xev->window;
+		evs[n].window.resize.w = xev->width;
+		evs[n].window.resize.h = xev->height;
+		++n;
+	}
+	if(geom.x != xev->x || geom.y != xev->y) {
+		evs[n].code = event::WINDOW_MOVE;
+		evs[n].target = xev->window;
+		evs[n].window.move.x = xev->x;
+		evs[n].window.move.y = xev->y;
+		++n;
+	}
+	
+	geom.x = xev->x;
+	geom.y = xev->y;
+	geom.w = xev->width;
+	geom.h = xev->height;
+	geom.bw = xev->border_width;
+	
+	// Each request is answered by a notify, unless a window manager
+	//  redirects it, so the server has the final say once as many have
+	//  come back or it reports what was last asked for
+	auto& want = f->wanted;
+	if(
+		want.x == geom.x && want.y == geom.y &&
+		want.w == geom.w && want.h == geom.h && want.bw == geom.bw
+	) {
+		f->configuring = 0;
+	}
+	else if(f->configuring) {
+		--f->configuring;
+	}
+	if(!f->configuring) {
+		want = geom;
+	}
+	
+	return n;
+}
+
+/**
+ * Translate an XCB event into evs (which has room for at least two
+ *  events), returning how many it became. Takes ownership of xcb_ev.
+**/
+uint translate_event(xcb_generic_event_t* xcb_ev, event::Any* evs) {
+	auto* ev = &evs[0];
+	
+	// Anything the server sends back means every request before it
+	//  got through
+	if(xcb_ev->response_type) {
+		prune_requests(xcb_ev->full_sequence);
+	}
+	
+	if(shm_completed(xcb_ev)) {
+		goto LABEL_ignore;
 	}
 	
 	switch(xcb_ev->response_type & ~0x80) {
-		// This appears at the beginning of a connection. The only
-		//  documentation I could find suggested 0 is reserved for
-		//  errors
-		case 0: goto LABEL_ignore;
+		// Errors for requests sent unchecked
+		case 0: {
+			auto* xerr = (xcb_generic_error_t*)xcb_ev;
+			auto* req = find_request(xerr->full_sequence);
+			
+			ev->code = event::ERROR;
+			ev->target = req? req->owner : 0;
+			
+			ev->error.code = xerr->error_code;
+			ev->error.major = xerr->major_code;
+			ev->error.minor = xerr->minor_code;
+			ev->error.site = req? req->site : 0;
+			ev->error.resource = xerr->resource_id;
+			ev->error.sequence = xerr->full_sequence;
+			break;
+		}
 		
 		case XCB_EXPOSE: {
 			auto* xev = (xcb_expose_event_t*)xcb_ev;
 			
 			ev->code = event::WINDOW_DRAW;
 			ev->target = xev->window;
+			
+			ev->window.draw.x = xev->x;
+			ev->window.draw.y = xev->y;
+			ev->window.draw.w = xev->width;
+			ev->window.draw.h = xev->height;
+			ev->window.draw.count = xev->count;
 			break;
 		}
 		
@@ -703,13 +2020,17 @@ bool pollEvent(event::Any* ev) {
 			//  guarantee. Thus for type safety, extract detail
 			xcb_button_t button;
 			frame_id_t target;
+			int x, y;
 			
 			case XCB_BUTTON_PRESS: {
 				auto* xev = (xcb_button_press_event_t*)xcb_ev;
 				ev->mouse.press.state = true;
 				
 				button = xev->detail;
-				target = xev->child || xev->event || xev->root;
+				target = pick_target(xev->child, xev->event, xev->root);
+				x = xev->event_x;
+				y = xev->event_y;
+				target_coords(target, xev->event, x, y);
 				
 				goto LABEL_mouse_event;
 			}
@@ -718,23 +2039,34 @@ bool pollEvent(event::Any* ev) {
 				ev->mouse.press.state = false;
 				
 				button = xev->detail;
-				target = xev->child || xev->event || xev->root;
+				target = pick_target(xev->child, xev->event, xev->root);
+				x = xev->event_x;
+				y = xev->event_y;
+				target_coords(target, xev->event, x, y);
 				
 				goto LABEL_mouse_event;
 			}
 			LABEL_mouse_event: {
 				ev->target = target;
 				
-				// 3 and 4 are the mouse wheel "buttons"
-				if(button == 3 || button == 4) {
+				// 4 and 5 are the mouse wheel "buttons", up and down. Each
+				//  notch is a press and release, so releases are dropped
+				if(button == 4 || button == 5) {
+					if(!ev->mouse.press.state) {
+						goto LABEL_ignore;
+					}
 					ev->code = event::MOUSE_WHEEL;
-					ev->mouse.wheel.delta = button;
+					ev->mouse.wheel.delta = button == 4? -1 : 1;
+					ev->mouse.wheel.x = x;
+					ev->mouse.wheel.y = y;
 				}
 				else {
 					ev->code = event::MOUSE_PRESS;
 					ev->mouse.press.button =
 						xcb2satori_mousebutton(button);
 					ev->mouse.press.dragging = false;
+					ev->mouse.press.x = x;
+					ev->mouse.press.y = y;
 				}
 				break;
 			}
@@ -745,25 +2077,29 @@ bool pollEvent(event::Any* ev) {
 			auto* xev = (xcb_motion_notify_event_t*)xcb_ev;
 			
 			ev->code = event::MOUSE_MOVE;
-			ev->target = xev->child || xev->event || xev->root;
+			ev->target = pick_target(xev->child, xev->event, xev->root);
 			
-			ev->mouse.move.x = xev->event_x;
-			ev->mouse.move.y = xev->event_y;
+			int x = xev->event_x, y = xev->event_y;
+			target_coords(ev->target, xev->event, x, y);
+			ev->mouse.move.x = x;
+			ev->mouse.move.y = y;
 			
 			break;
 		}
 		
 		/*** BEGIN: Mouse hover event handling ***/
 		{
-			int x, y, target;
+			frame_id_t target;
+			int x, y;
 			
 			case XCB_ENTER_NOTIFY: {
 				auto* xev = (xcb_enter_notify_event_t*)xcb_ev;
 				ev->mouse.hover.state = true;
 				
-				target = xev->child || xev->event || xev->root;
+				target = pick_target(xev->child, xev->event, xev->root);
 				x = xev->event_x;
 				y = xev->event_y;
+				target_coords(target, xev->event, x, y);
 				
 				goto LABEL_hover_event;
 			}
@@ -771,9 +2107,10 @@ bool pollEvent(event::Any* ev) {
 				auto* xev = (xcb_leave_notify_event_t*)xcb_ev;
 				ev->mouse.hover.state = false;
 				
-				target = xev->child || xev->event || xev->root;
+				target = pick_target(xev->child, xev->event, xev->root);
 				x = xev->event_x;
 				y = xev->event_y;
+				target_coords(target, xev->event, x, y);
 				
 				goto LABEL_hover_event;
 			}
@@ -799,7 +2136,7 @@ bool pollEvent(event::Any* ev) {
 				auto* xev = (xcb_key_press_event_t*)xcb_ev;
 				ev->key.press.state = true;
 				
-				target = xev->child || xev->event || xev->root;
+				target = pick_target(xev->child, xev->event, xev->root);
 				key = xev->detail;
 				mods = (xcb_mod_mask_t)xev->state;
 				
@@ -809,7 +2146,7 @@ bool pollEvent(event::Any* ev) {
 				auto* xev = (xcb_key_release_event_t*)xcb_ev;
 				ev->key.press.state = false;
 				
-				target = xev->child || xev->event || xev->root;
+				target = pick_target(xev->child, xev->event, xev->root);
 				key = xev->detail;
 				mods = (xcb_mod_mask_t)xev->state;
 				
@@ -864,8 +2201,17 @@ bool pollEvent(event::Any* ev) {
 		case XCB_UNMAP_NOTIFY:
 		case XCB_MAP_NOTIFY:
 		case XCB_MAP_REQUEST:
+			goto LABEL_no_impl;
+		
+		case XCB_CONFIGURE_NOTIFY: {
+			auto* xev = (xcb_configure_notify_event_t*)xcb_ev;
+			
+			uint n = configure_notify(xev, evs);
+			free(xcb_ev);
+			return n;
+		}
+		
 		case XCB_REPARENT_NOTIFY:
-		case XCB_CONFIGURE_NOTIFY:
 		case XCB_CONFIGURE_REQUEST:
 		case XCB_GRAVITY_NOTIFY:
 		case XCB_RESIZE_REQUEST:
@@ -883,12 +2229,12 @@ bool pollEvent(event::Any* ev) {
 	
 	LABEL_done: {
 		free(xcb_ev);
-		return true;
+		return 1;
 	}
 	
 	LABEL_ignore: {
 		free(xcb_ev);
-		return false;
+		return 0;
 	}
 	
 	// Handle any events that we've listed but not implemented
@@ -898,6 +2244,123 @@ bool pollEvent(event::Any* ev) {
 	}
 }
 
+/**
+ * Read everything XCB has for us into event_queue. Within one drain,
+ *  consecutive pointer motion in a window collapses into the latest
+ *  one, and each window's exposures merge into a single draw carrying
+ *  the bounding box of the damage.
+**/
+void drain_events() {
+	// Queue positions of the motion and draw events which later ones
+	//  can still be folded into
+	std::unordered_map<frame_id_t, size_t> last_motion, last_draw;
+	
+	while(auto* xcb_ev = next_event()) {
+		event::Any evs[2];
+		memset(evs, 0, sizeof(evs));
+		
+		uint n = translate_event(xcb_ev, evs);
+		
+		for(uint i = 0; i < n; ++i) {
+			auto& ev = evs[i];
+			
+			if(ev.code == event::MOUSE_MOVE) {
+				auto it = last_motion.find(ev.target);
+				if(it != last_motion.end()) {
+					event_queue[it->second] = ev;
+					continue;
+				}
+				
+				last_motion[ev.target] = event_queue.size();
+			}
+			else if(ev.code == event::WINDOW_DRAW) {
+				auto& draw = ev.window.draw;
+				
+				// The event only carries the bounding box, the frame
+				//  keeps exactly what was exposed
+				auto* f = Frame::lookup(ev.target);
+				if(f) {
+					f->damage.unite(Region(draw.x, draw.y, draw.w, draw.h));
+				}
+				
+				// Nothing gets drawn until the whole series is in
+				auto pit = partial_exposes.find(ev.target);
+				if(pit != partial_exposes.end()) {
+					union_damage(draw, pit->second);
+					
+					if(draw.count) {
+						pit->second = draw;
+						continue;
+					}
+					partial_exposes.erase(pit);
+				}
+				else if(draw.count) {
+					partial_exposes[ev.target] = draw;
+					continue;
+				}
+				
+				// Buffered and retained drawing is answered without
+				//  involving JS
+				if(f && f->buffered) {
+					if(f->exposeFromBack(draw)) {
+						continue;
+					}
+					
+					// The buffer gets redrawn, so this is what to copy
+					f->ensureBack();
+					f->damageBack(draw);
+				}
+				else if(f && f->retained && !f->display_list.empty()) {
+					f->replay();
+					continue;
+				}
+				
+				auto it = last_draw.find(ev.target);
+				if(it != last_draw.end()) {
+					union_damage(event_queue[it->second].window.draw, draw);
+					continue;
+				}
+				
+				last_draw[ev.target] = event_queue.size();
+			}
+			else {
+				// Anything else in between means the motion before it
+				//  has to be delivered in order
+				last_motion.erase(ev.target);
+			}
+			
+			event_queue.push_back(ev);
+		}
+	}
+}
+
+bool pollEvent(event::Any* ev) {
+	if(event_queue.empty()) {
+		drain_events();
+		
+		if(event_queue.empty()) {
+			return false;
+		}
+	}
+	
+	*ev = event_queue.front();
+	event_queue.pop_front();
+	
+	return true;
+}
+
+/**
+ * Drain up to max events in one call, returning how many were read.
+**/
+uint pollEvents(event::Any* evs, uint max) {
+	uint n = 0;
+	while(n < max && pollEvent(&evs[n])) {
+		++n;
+	}
+	
+	return n;
+}
+
 void dispatchEvent() {
 	
 }
@@ -906,9 +2369,8 @@ void globalFlush() {
 	for(auto* f : Frame::toflush) {
 		f->flush();
 	}
-	for(auto* gc : GraphicsContext::toflush) {
-		gc->flush();
-	}
+	Frame::toflush.clear();
+	
 	xcb_flush(conn);
 }
 
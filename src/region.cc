@@ -0,0 +1,246 @@
+/**
+ * This file is intended to be included into native.cpp
+ *
+ * Regions as lists of banded boxes, the way the server keeps them. Boxes
+ *  are sorted top to bottom then left to right, every box in a band has
+ *  the same top and bottom, boxes in a band don't touch, and vertically
+ *  adjacent bands with the same spans are merged. This is the order
+ *  YXBanded clip lists need, so they can be sent as they are.
+**/
+
+struct Region {
+	struct Box {
+		int x1, y1, x2, y2;
+	};
+	
+	enum Op {
+		UNION, INTERSECT, SUBTRACT
+	};
+	
+	std::vector<Box> boxes;
+	
+	Region() {}
+	
+	Region(int x, int y, uint w, uint h) {
+		if(w && h) {
+			boxes.push_back(Box{x, y, x + (int)w, y + (int)h});
+		}
+	}
+	
+	bool empty() const {
+		return boxes.empty();
+	}
+	
+	void clear() {
+		boxes.clear();
+	}
+	
+	/**
+	 * The smallest box containing the region, all 0 if it's empty.
+	**/
+	Box extents() const {
+		if(boxes.empty()) {
+			return Box{0, 0, 0, 0};
+		}
+		
+		Box e{boxes.front().x1, boxes.front().y1, 0, boxes.back().y2};
+		e.x2 = boxes.front().x2;
+		for(auto& b : boxes) {
+			e.x1 = std::min(e.x1, b.x1);
+			e.x2 = std::max(e.x2, b.x2);
+		}
+		return e;
+	}
+	
+	bool intersects(int x, int y, uint w, uint h) const {
+		if(!w || !h) {
+			return false;
+		}
+		int x2 = x + (int)w, y2 = y + (int)h;
+		
+		for(auto& b : boxes) {
+			if(b.y1 >= y2) {
+				break;
+			}
+			if(b.y2 > y && b.x1 < x2 && b.x2 > x) {
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	void translate(int dx, int dy) {
+		for(auto& b : boxes) {
+			b.x1 += dx;
+			b.x2 += dx;
+			b.y1 += dy;
+			b.y2 += dy;
+		}
+	}
+	
+	void unite(const Region& r) {
+		combine(r, UNION);
+	}
+	void intersect(const Region& r) {
+		combine(r, INTERSECT);
+	}
+	void subtract(const Region& r) {
+		combine(r, SUBTRACT);
+	}
+	
+	/**
+	 * The boxes as X rectangles, clamped to what fits in them.
+	**/
+	std::vector<xcb_rectangle_t> rects() const {
+		std::vector<xcb_rectangle_t> out(boxes.size());
+		
+		for(uint i = 0; i < boxes.size(); ++i) {
+			auto& b = boxes[i];
+			int x = clamp16(b.x1), y = clamp16(b.y1);
+			
+			out[i] = xcb_rectangle_t{
+				(int16_t)x, (int16_t)y,
+				(uint16_t)std::min(clamp16(b.x2) - x, 0xffff),
+				(uint16_t)std::min(clamp16(b.y2) - y, 0xffff)
+			};
+		}
+		return out;
+	}
+	
+	static int clamp16(int v) {
+		return std::max(-0x8000, std::min(v, 0x7fff));
+	}
+	
+	/**
+	 * Combine two sorted lists of disjoint [x1, x2) spans.
+	**/
+	static void combineSpans(
+		const std::vector<int>& a, const std::vector<int>& b, Op op,
+		std::vector<int>& out
+	) {
+		std::vector<int> xs;
+		xs.reserve(a.size() + b.size());
+		std::merge(
+			a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(xs)
+		);
+		xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+		
+		size_t i = 0, j = 0;
+		for(size_t k = 0; k + 1 < xs.size(); ++k) {
+			int x0 = xs[k], x1 = xs[k + 1];
+			
+			while(i < a.size() && a[i + 1] <= x0) i += 2;
+			while(j < b.size() && b[j + 1] <= x0) j += 2;
+			
+			bool ina = i < a.size() && a[i] <= x0;
+			bool inb = j < b.size() && b[j] <= x0;
+			bool keep =
+				op == UNION? ina || inb :
+				op == INTERSECT? ina && inb :
+				ina && !inb;
+			
+			if(!keep) {
+				continue;
+			}
+			if(out.size() && out.back() == x0) {
+				out.back() = x1;
+			}
+			else {
+				out.push_back(x0);
+				out.push_back(x1);
+			}
+		}
+	}
+	
+	/**
+	 * The spans of the band covering y, moving i up to it. Bands are
+	 *  visited top to bottom, so i only ever moves forward.
+	**/
+	static void bandSpans(
+		const std::vector<Box>& boxes, size_t& i, int y,
+		std::vector<int>& out
+	) {
+		out.clear();
+		while(i < boxes.size() && boxes[i].y2 <= y) {
+			++i;
+		}
+		
+		if(i == boxes.size() || boxes[i].y1 > y) {
+			return;
+		}
+		
+		int top = boxes[i].y1;
+		for(size_t k = i; k < boxes.size() && boxes[k].y1 == top; ++k) {
+			out.push_back(boxes[k].x1);
+			out.push_back(boxes[k].x2);
+		}
+	}
+	
+	/**
+	 * Sweep down both regions one band at a time, combining the spans of
+	 *  each and merging bands which come out the same.
+	**/
+	void combine(const Region& r, Op op) {
+		// Shortcuts for the common cases of an empty side
+		if(r.empty()) {
+			if(op == INTERSECT) {
+				clear();
+			}
+			return;
+		}
+		if(empty()) {
+			if(op == UNION) {
+				boxes = r.boxes;
+			}
+			return;
+		}
+		
+		std::vector<int> ys;
+		ys.reserve(2*(boxes.size() + r.boxes.size()));
+		for(auto& b : boxes) {
+			ys.push_back(b.y1);
+			ys.push_back(b.y2);
+		}
+		for(auto& b : r.boxes) {
+			ys.push_back(b.y1);
+			ys.push_back(b.y2);
+		}
+		std::sort(ys.begin(), ys.end());
+		ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+		
+		std::vector<Box> out;
+		std::vector<int> sa, sb, spans, last;
+		size_t ia = 0, ib = 0, band = 0;
+		
+		for(size_t k = 0; k + 1 < ys.size(); ++k) {
+			int y0 = ys[k], y1 = ys[k + 1];
+			
+			bandSpans(boxes, ia, y0, sa);
+			bandSpans(r.boxes, ib, y0, sb);
+			spans.clear();
+			combineSpans(sa, sb, op, spans);
+			
+			if(spans.empty()) {
+				last.clear();
+				continue;
+			}
+			
+			// Extend the band above if it's directly on top with the
+			//  same spans
+			if(out.size() && out.back().y2 == y0 && spans == last) {
+				for(size_t i = band; i < out.size(); ++i) {
+					out[i].y2 = y1;
+				}
+				continue;
+			}
+			
+			band = out.size();
+			for(size_t i = 0; i < spans.size(); i += 2) {
+				out.push_back(Box{spans[i], y0, spans[i + 1], y1});
+			}
+			last.swap(spans);
+		}
+		
+		boxes.swap(out);
+	}
+};
@@ -0,0 +1,172 @@
+/**
+ * This file is intended to be included into native.cpp
+ *
+ * Setup for the XRender extension. The server's picture formats are
+ *  fetched once at connection time so pictures and glyph sets can be
+ *  created without asking again.
+**/
+
+// Whether the server has a usable RENDER extension
+static bool has_render = false;
+
+// The server's picture formats, kept for the life of the connection
+static xcb_render_query_pict_formats_reply_t* pict_formats = nullptr;
+
+// 1-bit alpha, used for glyph masks
+static xcb_render_pictformat_t a1_format = 0;
+// 8-bit alpha, so overlapping shapes in one request blend only once
+static xcb_render_pictformat_t a8_format = 0;
+
+// 32-bit premultiplied ARGB, for translucent windows and images
+static xcb_render_pictformat_t argb_format = 0;
+// A visual whose windows use argb_format, or 0 if the server has none
+static xcb_visualid_t argb_visual = 0;
+
+/**
+ * Find a direct format with the given depth and channel masks.
+**/
+xcb_render_pictformat_t find_format(
+	uint depth, uint alpha, uint red, uint green, uint blue
+) {
+	auto it = xcb_render_query_pict_formats_formats_iterator(pict_formats);
+	for(; it.rem; xcb_render_pictforminfo_next(&it)) {
+		auto* f = it.data;
+		auto& d = f->direct;
+		
+		if(
+			f->type == XCB_RENDER_PICT_TYPE_DIRECT &&
+			f->depth == depth && d.alpha_mask == alpha &&
+			d.red_mask == red && d.green_mask == green &&
+			d.blue_mask == blue
+		) {
+			return f->id;
+		}
+	}
+	
+	return 0;
+}
+
+/**
+ * Find the format pictures of windows with the given visual use.
+**/
+xcb_render_pictformat_t visual_format(xcb_visualid_t visual) {
+	auto screens =
+		xcb_render_query_pict_formats_screens_iterator(pict_formats);
+	for(; screens.rem; xcb_render_pictscreen_next(&screens)) {
+		auto depths = xcb_render_pictscreen_depths_iterator(screens.data);
+		for(; depths.rem; xcb_render_pictdepth_next(&depths)) {
+			auto visuals =
+				xcb_render_pictdepth_visuals_iterator(depths.data);
+			for(; visuals.rem; xcb_render_pictvisual_next(&visuals)) {
+				if(visuals.data->visual == visual) {
+					return visuals.data->format;
+				}
+			}
+		}
+	}
+	
+	return 0;
+}
+
+/**
+ * Find the 32-bit format laid out the way the ARGB_PREMUL conversion
+ *  writes pixels, alpha in the top byte down to blue in the bottom.
+**/
+xcb_render_pictformat_t find_argb_format() {
+	auto it = xcb_render_query_pict_formats_formats_iterator(pict_formats);
+	for(; it.rem; xcb_render_pictforminfo_next(&it)) {
+		auto* f = it.data;
+		auto& d = f->direct;
+		
+		if(
+			f->type == XCB_RENDER_PICT_TYPE_DIRECT && f->depth == 32 &&
+			d.alpha_mask == 0xff && d.alpha_shift == 24 &&
+			d.red_mask == 0xff && d.red_shift == 16 &&
+			d.green_mask == 0xff && d.green_shift == 8 &&
+			d.blue_mask == 0xff && d.blue_shift == 0
+		) {
+			return f->id;
+		}
+	}
+	
+	return 0;
+}
+
+/**
+ * Find a depth 32 visual with the ARGB format, which is what
+ *  compositing managers look for to blend a window with what's behind.
+**/
+xcb_visualid_t find_argb_visual() {
+	auto screens =
+		xcb_render_query_pict_formats_screens_iterator(pict_formats);
+	for(; screens.rem; xcb_render_pictscreen_next(&screens)) {
+		auto depths = xcb_render_pictscreen_depths_iterator(screens.data);
+		for(; depths.rem; xcb_render_pictdepth_next(&depths)) {
+			if(depths.data->depth != 32) {
+				continue;
+			}
+			
+			auto visuals =
+				xcb_render_pictdepth_visuals_iterator(depths.data);
+			for(; visuals.rem; xcb_render_pictvisual_next(&visuals)) {
+				if(visuals.data->format == argb_format) {
+					return visuals.data->visual;
+				}
+			}
+		}
+	}
+	
+	return 0;
+}
+
+/**
+ * A color in RENDER's terms, premultiplied with 16-bit channels, from
+ *  RGBA.
+**/
+xcb_render_color_t render_color(uint rgba) {
+	uint a = rgba&0xff;
+	return xcb_render_color_t{
+		(uint16_t)(convert::mul_div255(rgba>>24, a)*257),
+		(uint16_t)(convert::mul_div255((rgba>>16)&0xff, a)*257),
+		(uint16_t)(convert::mul_div255((rgba>>8)&0xff, a)*257),
+		(uint16_t)(a*257)
+	};
+}
+
+/**
+ * Check for RENDER and fetch its formats. Without it, text falls back
+ *  to the core protocol.
+**/
+void init_render() {
+	auto* ext = xcb_get_extension_data(conn, &xcb_render_id);
+	if(!ext || !ext->present) {
+		return;
+	}
+	
+	// Both requests go out before either reply is waited on
+	auto version_cookie = xcb_render_query_version(conn, 0, 11);
+	auto formats_cookie = xcb_render_query_pict_formats(conn);
+	
+	free(xcb_render_query_version_reply(conn, version_cookie, nullptr));
+	pict_formats = xcb_render_query_pict_formats_reply(
+		conn, formats_cookie, nullptr
+	);
+	if(!pict_formats) {
+		return;
+	}
+	
+	a1_format = find_format(1, 1, 0, 0, 0);
+	has_render = a1_format != 0;
+	a8_format = find_format(8, 0xff, 0, 0, 0);
+	
+	argb_format = find_argb_format();
+	if(argb_format) {
+		argb_visual = find_argb_visual();
+	}
+}
+
+void deinit_render() {
+	free(pict_formats);
+	pict_formats = nullptr;
+	has_render = false;
+}
@@ -0,0 +1,119 @@
+/**
+ * This file is intended to be included into native.cpp
+ *
+ * Offsets of the rows of a virtual list, which may be far too long to
+ *  keep anything per row in JS. Rows are taken to be the estimated
+ *  height until told otherwise, and a Fenwick tree of how far each is
+ *  off gives the offset of any row, or the row at any offset, in
+ *  O(log n). The tree isn't made until some row is off, so a list of
+ *  uniform rows costs nothing however long it is.
+**/
+
+struct RowIndex {
+	uint n;
+	int estimate;
+	
+	// 1-based tree over each row's height minus the estimate
+	std::vector<int64_t> tree;
+	
+	RowIndex(uint count, int est):n(count), estimate(std::max(est, 1)) {}
+	
+	static uint lowbit(uint i) {
+		return i&(~i + 1);
+	}
+	
+	/**
+	 * How far the first i rows are off the estimate in total.
+	**/
+	int64_t drift(uint i) const {
+		int64_t sum = 0;
+		if(tree.size()) {
+			for(i = std::min(i, n); i; i -= lowbit(i)) {
+				sum += tree[i];
+			}
+		}
+		return sum;
+	}
+	
+	/**
+	 * Where row i starts, or where the list ends for i = n.
+	**/
+	int64_t offset(uint i) const {
+		i = std::min(i, n);
+		return (int64_t)i*estimate + drift(i);
+	}
+	
+	int64_t total() const {
+		return offset(n);
+	}
+	
+	int height(uint i) const {
+		return i < n? offset(i + 1) - offset(i) : 0;
+	}
+	
+	void setHeight(uint i, int h) {
+		int64_t d = std::max(h, 0) - height(i);
+		if(i >= n || !d) {
+			return;
+		}
+		
+		if(tree.empty()) {
+			tree.assign(n + 1, 0);
+		}
+		for(uint j = i + 1; j <= n; j += lowbit(j)) {
+			tree[j] += d;
+		}
+	}
+	
+	/**
+	 * Change the row count. Rows added are the estimated height, and
+	 *  the heights of those kept stay as they were.
+	**/
+	void setCount(uint count) {
+		uint old = n;
+		n = count;
+		if(tree.empty()) {
+			return;
+		}
+		
+		// Entries up to count only cover rows before it, so they're
+		//  still right once the rest are cut off
+		tree.resize(count + 1);
+		
+		// A new entry covers the rows before it back to its low bit, and
+		//  the new rows among them have no drift of their own
+		for(uint j = old + 1; j <= count; ++j) {
+			tree[j] = drift(j - 1) - drift(j - lowbit(j));
+		}
+	}
+	
+	/**
+	 * The row y is in, clamped to the rows there are.
+	**/
+	uint find(int64_t y) const {
+		if(!n || y <= 0) {
+			return 0;
+		}
+		if(tree.empty()) {
+			return std::min<int64_t>(y/estimate, n - 1);
+		}
+		
+		// Walk down the tree, keeping the most rows which end by y
+		uint pos = 0, step = 1;
+		while(step <= n/2) {
+			step <<= 1;
+		}
+		
+		int64_t at = 0;
+		for(; step; step >>= 1) {
+			if(pos + step <= n) {
+				int64_t span = tree[pos + step] + (int64_t)step*estimate;
+				if(at + span <= y) {
+					pos += step;
+					at += span;
+				}
+			}
+		}
+		return std::min(pos, n - 1);
+	}
+};
@@ -0,0 +1,521 @@
+/**
+ * This file is intended to be included into native.cpp
+ *
+ * Text drawn through XRender glyph sets. Each core font's glyphs are
+ *  rasterized by the server once, read back, and uploaded to a glyph
+ *  set, after which a run of text is a single CompositeGlyphs request
+ *  no matter how long it is.
+**/
+
+// Glyph slots in the rasterization strip start on 32-bit boundaries
+//  so rows can be copied out without shifting any bits
+#define GLYPH_SLOT_ALIGN 32
+// Widest strip rasterized with one GetImage
+#define GLYPH_STRIP_WIDTH 2048
+// Solid fill pictures kept before they're all released
+#define MAX_SOLID_FILLS 256
+
+/**
+ * Largest request the server accepts in bytes, header included.
+**/
+uint max_request_bytes() {
+	static uint max_bytes = 0;
+	if(!max_bytes) {
+		max_bytes = xcb_get_maximum_request_length(conn)*4;
+	}
+	return max_bytes;
+}
+
+/**
+ * Decode UTF-8 into codepoints. Malformed sequences become U+FFFD
+ *  rather than stopping the decode.
+**/
+void decode_utf8(const char* s, uint n, std::vector<uint>& out) {
+	auto* c = (const uint8_t*)s;
+	uint i = 0;
+	
+	while(i < n) {
+		uint cp = c[i], extra;
+		
+		if(cp < 0x80) {
+			extra = 0;
+		}
+		else if((cp&0xe0) == 0xc0) {
+			cp &= 0x1f;
+			extra = 1;
+		}
+		else if((cp&0xf0) == 0xe0) {
+			cp &= 0x0f;
+			extra = 2;
+		}
+		else if((cp&0xf8) == 0xf0) {
+			cp &= 0x07;
+			extra = 3;
+		}
+		else {
+			out.push_back(0xfffd);
+			++i;
+			continue;
+		}
+		
+		uint j = 1;
+		for(; j <= extra && i + j < n && (c[i + j]&0xc0) == 0x80; ++j) {
+			cp = (cp<<6)|(c[i + j]&0x3f);
+		}
+		
+		out.push_back(j == extra + 1? cp : 0xfffd);
+		i += j;
+	}
+}
+
+/**
+ * A core font's metrics and the glyph set its glyphs are uploaded to.
+ *  The metrics are fetched when the font is opened, so text can be
+ *  measured without the server. Glyph ids are indexes into the font's
+ *  char_infos.
+**/
+struct GlyphFont {
+	xcb_font_t font;
+	
+	int ascent, descent;
+	uint min_byte1, max_byte1, min_char, max_char, default_char;
+	xcb_charinfo_t max_bounds;
+	// Empty if every character has max_bounds
+	std::vector<xcb_charinfo_t> chars;
+	
+	xcb_render_glyphset_t glyphset = 0;
+	// Which glyph ids have been uploaded
+	std::vector<bool> loaded;
+	
+	GlyphFont(xcb_font_t f, xcb_query_font_reply_t* reply):font(f) {
+		ascent = reply->font_ascent;
+		descent = reply->font_descent;
+		min_byte1 = reply->min_byte1;
+		max_byte1 = reply->max_byte1;
+		min_char = reply->min_char_or_byte2;
+		max_char = reply->max_char_or_byte2;
+		default_char = reply->default_char;
+		max_bounds = reply->max_bounds;
+		
+		auto* infos = xcb_query_font_char_infos(reply);
+		chars.assign(
+			infos, infos + xcb_query_font_char_infos_length(reply)
+		);
+		
+		loaded.resize(
+			(max_byte1 - min_byte1 + 1)*(max_char - min_char + 1)
+		);
+	}
+	
+	/**
+	 * The glyph id of a character, or -1 if the font doesn't have it.
+	**/
+	int index(uint cp) {
+		uint b1 = cp>>8, b2 = cp&0xff;
+		if(
+			cp > 0xffff || b1 < min_byte1 || b1 > max_byte1 ||
+			b2 < min_char || b2 > max_char
+		) {
+			return -1;
+		}
+		
+		uint cols = max_char - min_char + 1;
+		uint id = (b1 - min_byte1)*cols + b2 - min_char;
+		
+		// Nonexistent characters have all-zero metrics
+		auto& ci = info(id);
+		if(
+			!ci.character_width && !ci.left_side_bearing &&
+			!ci.right_side_bearing && !ci.ascent && !ci.descent
+		) {
+			return -1;
+		}
+		
+		return id;
+	}
+	
+	/**
+	 * Same as index(), but using the default character for anything
+	 *  that's missing.
+	**/
+	int glyph(uint cp) {
+		int id = index(cp);
+		return id < 0? index(default_char) : id;
+	}
+	
+	const xcb_charinfo_t& info(uint id) {
+		return chars.empty()? max_bounds : chars[id];
+	}
+	
+	/**
+	 * Character code of a glyph id, as a big-endian CHAR2B.
+	**/
+	xcb_char2b_t char2b(uint id) {
+		uint cols = max_char - min_char + 1;
+		return xcb_char2b_t{
+			(uint8_t)(id/cols + min_byte1), (uint8_t)(id%cols + min_char)
+		};
+	}
+	
+	/**
+	 * Upload whichever of the given glyphs aren't in the glyph set yet.
+	**/
+	void load(const std::vector<int>& ids) {
+		std::vector<uint> missing;
+		for(auto id : ids) {
+			if(id >= 0 && !loaded[id]) {
+				loaded[id] = true;
+				missing.push_back(id);
+			}
+		}
+		
+		if(missing.empty()) {
+			return;
+		}
+		
+		if(!glyphset) {
+			glyphset = xcb_generate_id(conn);
+			track_request(
+				xcb_render_create_glyph_set(conn, glyphset, a1_format),
+				0, "Glyph set creation"
+			);
+		}
+		
+		// Rasterize as many glyphs at a time as fit in one strip
+		uint first = 0, width = 0;
+		for(uint i = 0; i < missing.size(); ++i) {
+			uint w = slot(missing[i]);
+			
+			if(width + w > GLYPH_STRIP_WIDTH && i > first) {
+				rasterize(&missing[first], i - first, width);
+				first = i;
+				width = 0;
+			}
+			width += w;
+		}
+		rasterize(&missing[first], missing.size() - first, width);
+	}
+	
+	/**
+	 * Width of a glyph's slot in the rasterization strip.
+	**/
+	uint slot(uint id) {
+		auto& ci = info(id);
+		int w = ci.right_side_bearing - ci.left_side_bearing;
+		
+		if(w <= 0 || ci.ascent + ci.descent <= 0) {
+			return 0;
+		}
+		uint align = GLYPH_SLOT_ALIGN;
+		return (w + align - 1)/align*align;
+	}
+	
+	/**
+	 * Have the server draw glyphs side by side into a bitmap, read it
+	 *  back, and cut it up into A1 glyph images.
+	**/
+	void rasterize(const uint* ids, uint n, uint width) {
+		std::vector<xcb_render_glyphinfo_t> infos(n);
+		std::vector<uint8_t> data;
+		
+		uint height = max_bounds.ascent + max_bounds.descent;
+		xcb_get_image_reply_t* image = nullptr;
+		
+		if(width && height) {
+			image = drawStrip(ids, n, width, height);
+		}
+		
+		uint in_stride = image?
+			xcb_get_image_data_length(image)/height : 0;
+		auto* in = image? xcb_get_image_data(image) : nullptr;
+		
+		// Glyphs and their images have to go out in as few requests as
+		//  the maximum request length allows
+		uint first = 0, x = 0;
+		size_t data_start = 0;
+		
+		for(uint i = 0; i < n; ++i) {
+			auto& ci = info(ids[i]);
+			auto& gi = infos[i];
+			uint w = slot(ids[i]);
+			
+			gi.x = -ci.left_side_bearing;
+			gi.y = ci.ascent;
+			gi.x_off = ci.character_width;
+			gi.y_off = 0;
+			
+			if(w && image) {
+				gi.width = ci.right_side_bearing - ci.left_side_bearing;
+				gi.height = ci.ascent + ci.descent;
+				
+				uint stride = (gi.width + 31)/32*4;
+				uint top = max_bounds.ascent - ci.ascent;
+				
+				for(uint y = 0; y < gi.height; ++y) {
+					auto* row = in + (top + y)*in_stride + x/8;
+					data.insert(data.end(), row, row + stride);
+				}
+				x += w;
+			}
+			else {
+				gi.width = gi.height = 0;
+			}
+			
+			size_t size = (i + 1 - first)*
+				(sizeof(uint) + sizeof(xcb_render_glyphinfo_t)) +
+				data.size() - data_start;
+			if(size > max_request_bytes()/2 || i + 1 == n) {
+				xcb_render_add_glyphs(
+					conn, glyphset, i + 1 - first, ids + first,
+					&infos[first], data.size() - data_start,
+					data.data() + data_start
+				);
+				first = i + 1;
+				data_start = data.size();
+			}
+		}
+		
+		free(image);
+	}
+	
+	xcb_get_image_reply_t* drawStrip(
+		const uint* ids, uint n, uint width, uint height
+	) {
+		xcb_pixmap_t pixmap = xcb_generate_id(conn);
+		xcb_gcontext_t gc = xcb_generate_id(conn);
+		
+		xcb_create_pixmap(conn, 1, pixmap, screen->root, width, height);
+		
+		uint values[] = {0, font, 0};
+		xcb_create_gc(conn, gc, pixmap,
+			XCB_GC_FOREGROUND | XCB_GC_FONT | XCB_GC_GRAPHICS_EXPOSURES,
+			values
+		);
+		
+		xcb_rectangle_t all{0, 0, (uint16_t)width, (uint16_t)height};
+		xcb_poly_fill_rectangle(conn, pixmap, gc, 1, &all);
+		
+		uint one = 1;
+		xcb_change_gc(conn, gc, XCB_GC_FOREGROUND, &one);
+		
+		int x = 0;
+		for(uint i = 0; i < n; ++i) {
+			uint w = slot(ids[i]);
+			if(!w) {
+				continue;
+			}
+			
+			// One text item: length, delta, then the character
+			auto c = char2b(ids[i]);
+			uint8_t item[] = {1, 0, c.byte1, c.byte2};
+			
+			xcb_poly_text_16(conn, pixmap, gc,
+				x - info(ids[i]).left_side_bearing, max_bounds.ascent,
+				sizeof(item), item
+			);
+			x += w;
+		}
+		
+		auto cookie = xcb_get_image(conn, XCB_IMAGE_FORMAT_Z_PIXMAP,
+			pixmap, 0, 0, width, height, ~0
+		);
+		
+		xcb_free_gc(conn, gc);
+		xcb_free_pixmap(conn, pixmap);
+		
+		xcb_generic_error_t* error;
+		auto* reply = xcb_get_image_reply(conn, cookie, &error);
+		if(error) {
+			auto err = buildError("Glyph rasterization failed", error);
+			free(error);
+			throw err;
+		}
+		
+		return reply;
+	}
+	
+	void close() {
+		if(glyphset) {
+			xcb_render_free_glyph_set(conn, glyphset);
+			glyphset = 0;
+		}
+	}
+};
+
+static std::unordered_map<xcb_font_t, GlyphFont> glyph_fonts;
+
+GlyphFont& add_glyph_font(xcb_font_t font, xcb_query_font_reply_t* reply) {
+	return glyph_fonts.emplace(font, GlyphFont(font, reply)).first->second;
+}
+
+/**
+ * Metrics of an open font. Fonts are normally queried by openFont(),
+ *  so this only waits on the server for fonts opened elsewhere.
+**/
+GlyphFont& glyph_font(xcb_font_t font) {
+	auto it = glyph_fonts.find(font);
+	if(it != glyph_fonts.end()) {
+		return it->second;
+	}
+	
+	xcb_generic_error_t* error;
+	auto* reply = xcb_query_font_reply(
+		conn, xcb_query_font(conn, font), &error
+	);
+	if(error) {
+		auto err = buildError("Querying font failed", error);
+		free(error);
+		throw err;
+	}
+	
+	auto& gf = add_glyph_font(font, reply);
+	free(reply);
+	return gf;
+}
+
+void forget_glyph_font(xcb_font_t font) {
+	auto it = glyph_fonts.find(font);
+	if(it != glyph_fonts.end()) {
+		it->second.close();
+		glyph_fonts.erase(it);
+	}
+}
+
+// Solid fill source pictures, keyed by RGBA
+static std::unordered_map<uint, xcb_render_picture_t> solid_fills;
+
+xcb_render_picture_t solid_fill(uint rgba) {
+	auto it = solid_fills.find(rgba);
+	if(it != solid_fills.end()) {
+		return it->second;
+	}
+	
+	if(solid_fills.size() >= MAX_SOLID_FILLS) {
+		for(auto& p : solid_fills) {
+			xcb_render_free_picture(conn, p.second);
+		}
+		solid_fills.clear();
+	}
+	
+	xcb_render_picture_t pic = xcb_generate_id(conn);
+	xcb_render_create_solid_fill(conn, pic, render_color(rgba));
+	
+	return solid_fills[rgba] = pic;
+}
+
+/**
+ * Draw UTF-8 text with its baseline origin at x, y. Uses the core
+ *  protocol if RENDER isn't available or no font has been set.
+**/
+void draw_text(
+	RenderTarget& rt, xcb_drawable_t target, xcb_gcontext_t gc,
+	const display::Style& style, int x, int y, const char* s, uint n
+) {
+	xcb_render_picture_t dst = 0;
+	if(has_render && style.font) {
+		dst = rt.getPicture(target);
+	}
+	
+	if(!dst) {
+		track_request(
+			xcb_image_text_8(conn, n, target, gc, x, y, s),
+			target, "GraphicsContext.drawText()"
+		);
+		return;
+	}
+	
+	auto& font = glyph_font(style.font);
+	
+	std::vector<uint> cps;
+	decode_utf8(s, n, cps);
+	
+	std::vector<int> ids(cps.size());
+	for(uint i = 0; i < cps.size(); ++i) {
+		ids[i] = font.glyph(cps[i]);
+	}
+	
+	// Printable ASCII is almost always needed, so it comes along with
+	//  the first glyphs loaded
+	if(!font.glyphset) {
+		std::vector<int> first(ids);
+		for(uint c = ' '; c <= '~'; ++c) {
+			first.push_back(font.index(c));
+		}
+		font.load(first);
+	}
+	else {
+		font.load(ids);
+	}
+	
+	// Each element holds up to 254 glyphs. The first element of a
+	//  request is positioned absolutely, the rest carry on from where
+	//  the last glyph left the pen.
+	std::vector<uint8_t> cmds;
+	uint max = max_request_bytes() - 32, count = 0;
+	size_t head = 0;
+	int pen = x;
+	
+	auto src = solid_fill(rt.styleColor(style));
+	auto send = [&]() {
+		if(cmds.size()) {
+			track_request(xcb_render_composite_glyphs_32(
+				conn, XCB_RENDER_PICT_OP_OVER, src, dst, 0,
+				font.glyphset, 0, 0, cmds.size(), cmds.data()
+			), target, "GraphicsContext.drawText()");
+			cmds.clear();
+		}
+	};
+	
+	for(auto id : ids) {
+		if(id < 0) {
+			continue;
+		}
+		
+		if(cmds.size() + sizeof(xcb_render_glyph_elt_t) + 4 > max) {
+			send();
+		}
+		if(cmds.empty() || count == 254) {
+			xcb_render_glyph_elt_t elt{};
+			if(cmds.empty()) {
+				elt.deltax = pen;
+				elt.deltay = y;
+			}
+			
+			head = cmds.size();
+			cmds.insert(cmds.end(),
+				(uint8_t*)&elt, (uint8_t*)&elt + sizeof(elt)
+			);
+			count = 0;
+		}
+		
+		uint glyph = id;
+		cmds.insert(cmds.end(),
+			(uint8_t*)&glyph, (uint8_t*)&glyph + sizeof(glyph)
+		);
+		// len is the element's first byte
+		cmds[head] = ++count;
+		
+		pen += font.info(id).character_width;
+	}
+	send();
+}
+
+/**
+ * Width of UTF-8 text as drawText() would draw it.
+**/
+int measure_text(xcb_font_t font, const char* s, uint n) {
+	static std::vector<uint> cps;
+	auto& gf = glyph_font(font);
+	
+	cps.clear();
+	decode_utf8(s, n, cps);
+	
+	int width = 0;
+	for(auto cp : cps) {
+		int id = gf.glyph(cp);
+		if(id >= 0) {
+			width += gf.info(id).character_width;
+		}
+	}
+	return width;
+}
@@ -0,0 +1,1012 @@
+/**
+ * This file is intended to be included into native.cpp
+ *
+ * The view tree, which every frame and windowless widget has a node in.
+ *  Nodes are indices into parallel arrays rather than objects, so walking
+ *  the tree to lay out, paint or hit test touches only the fields it
+ *  needs. A windowed frame hosts a subtree through a node of its own,
+ *  and any windowless node under it is painted into the frame's drawable.
+ *
+ * Layout is incremental. Changing what a node asks for marks it dirty,
+ *  and its ancestors only as far up as its size could matter to them.
+ *  A layout pass then skips every subtree which is clean and was given
+ *  the same space as last time.
+**/
+
+typedef uint view_id_t;
+
+struct ViewTree {
+	enum Flag {
+		ALIVE = 1,
+		HIDDEN = 2,
+		// Has its own window, so it isn't painted or hit by its parent
+		WINDOWED = 4,
+		// Has to arrange its children again
+		DIRTY = 8,
+		// Has a dirty node somewhere under it
+		CHILD_DIRTY = 16,
+		// The measure cache is filled, and good for any width
+		MEASURED = 32,
+		WIDTH_FREE = 64
+	};
+	
+	/**
+	 * How a node arranges its children, matching Order in container.js.
+	 *  NONE leaves them where they asked to be.
+	**/
+	enum Order {
+		NONE, STACK, ROW, COLUMN, FLOW, GRID
+	};
+	
+	struct Edges {
+		int left, top, right, bottom;
+	};
+	
+	struct Size {
+		uint w, h;
+	};
+	
+	/**
+	 * What a node asks of layout. This is only read when the node is
+	 *  laid out, so it's kept apart from the arrays walked every pass.
+	**/
+	struct Constraints {
+		uint8_t order;
+		
+		// Position under a parent with no order
+		int x, y;
+		// Size asked for, 0 to take the space given or the content's
+		uint w, h;
+		// A max of 0 is no limit
+		uint min_w, min_h, max_w, max_h;
+		
+		Edges padding, margin;
+		
+		// Cell under a grid, or a span of 0 to take the next free one
+		uint16_t col, row, col_span, row_span;
+	};
+	
+	/**
+	 * Tracks of a grid node and what was worked out from them. Only grid
+	 *  nodes have one, so they're kept by id.
+	**/
+	struct Grid {
+		enum Kind {
+			AUTO, FIXED, FRACTION
+		};
+		
+		// Value is pixels when fixed and thousandths when a fraction
+		struct Track {
+			uint8_t kind;
+			uint value;
+		};
+		std::vector<Track> cols, rows;
+		
+		// col, row, col span, row span of each child in order
+		std::vector<uint> cells;
+		
+		// Size of each track before fractions are shared out, good for
+		//  the generation and width they were worked out with
+		std::vector<uint> base_cols, base_rows;
+		bool based = false;
+		uint based_gen, based_w;
+		
+		// Where each track starts, then where the last ends
+		std::vector<int> col_at, row_at;
+		
+		// Cells are kept within this many tracks, so a stray index can't
+		//  make the track lists huge
+		static const uint MAX_TRACKS = 1000;
+		
+		static uint8_t kindAt(const std::vector<Track>& tracks, size_t i) {
+			// Tracks past those given are implicit and fit their content
+			return i < tracks.size()? tracks[i].kind : (uint8_t)AUTO;
+		}
+	};
+	std::unordered_map<view_id_t, Grid> grids;
+	
+	// Geometry relative to the parent, as of the last layout
+	std::vector<int> x, y;
+	std::vector<uint> w, h;
+	
+	// The space each node was last given, margins included
+	std::vector<int> slot_x, slot_y;
+	std::vector<uint> slot_w, slot_h;
+	
+	// Links, with 0 as null
+	std::vector<view_id_t> parent, first, last, next, prev;
+	
+	std::vector<uint8_t> flags;
+	std::vector<Constraints> box;
+	
+	// Bumped whenever what decides a node's size changes
+	std::vector<uint> gen;
+	
+	// The last measurement of each node, the width it was for and the
+	//  generation it was of
+	std::vector<Size> measured;
+	std::vector<uint> measured_for, measured_gen;
+	
+	// Ids of destroyed nodes, reused before the arrays grow
+	std::vector<view_id_t> free_ids;
+	
+	ViewTree() {
+		// Node 0 is never used so it can stand for none
+		grow();
+	}
+	
+	void grow() {
+		size_t n = flags.size() + 1;
+		
+		x.resize(n);
+		y.resize(n);
+		w.resize(n);
+		h.resize(n);
+		slot_x.resize(n);
+		slot_y.resize(n);
+		slot_w.resize(n);
+		slot_h.resize(n);
+		parent.resize(n);
+		first.resize(n);
+		last.resize(n);
+		next.resize(n);
+		prev.resize(n);
+		flags.resize(n);
+		box.resize(n);
+		gen.resize(n);
+		measured.resize(n);
+		measured_for.resize(n);
+		measured_gen.resize(n);
+	}
+	
+	bool alive(view_id_t id) {
+		return id && id < flags.size() && (flags[id]&ALIVE);
+	}
+	
+	view_id_t create(bool windowed) {
+		view_id_t id;
+		if(free_ids.size()) {
+			id = free_ids.back();
+			free_ids.pop_back();
+		}
+		else {
+			id = flags.size();
+			grow();
+		}
+		
+		x[id] = y[id] = 0;
+		w[id] = h[id] = 0;
+		slot_x[id] = slot_y[id] = 0;
+		slot_w[id] = slot_h[id] = 0;
+		parent[id] = first[id] = last[id] = next[id] = prev[id] = 0;
+		flags[id] = ALIVE|DIRTY|(windowed? WINDOWED : 0);
+		box[id] = Constraints();
+		++gen[id];
+		
+		return id;
+	}
+	
+	/**
+	 * Destroy a node and everything under it. Windowed nodes below it
+	 *  belong to frames which still hold their ids, so they're only cut
+	 *  loose, to be destroyed by those frames.
+	**/
+	void destroy(view_id_t id) {
+		if(!alive(id)) {
+			return;
+		}
+		
+		detach(id);
+		
+		std::vector<view_id_t> stack{id};
+		while(stack.size()) {
+			view_id_t n = stack.back();
+			stack.pop_back();
+			
+			for(view_id_t c = first[n], nc; c; c = nc) {
+				nc = next[c];
+				if(flags[c]&WINDOWED) {
+					detach(c);
+				}
+				else {
+					stack.push_back(c);
+				}
+			}
+			
+			flags[n] = 0;
+			grids.erase(n);
+			free_ids.push_back(n);
+		}
+	}
+	
+	void detach(view_id_t id) {
+		view_id_t p = parent[id];
+		if(!p) {
+			return;
+		}
+		
+		(prev[id]? next[prev[id]] : first[p]) = next[id];
+		(next[id]? prev[next[id]] : last[p]) = prev[id];
+		parent[id] = next[id] = prev[id] = 0;
+		
+		invalidate(p);
+	}
+	
+	/**
+	 * Make child the last (topmost) child of p, or insert it before
+	 *  another of p's children.
+	**/
+	void insert(view_id_t p, view_id_t child, view_id_t before) {
+		if(!alive(p) || !alive(child)) {
+			return;
+		}
+		
+		// A node can't go under itself, which would make a cycle
+		for(view_id_t a = p; a; a = parent[a]) {
+			if(a == child) {
+				return;
+			}
+		}
+		detach(child);
+		
+		if(before && parent[before] != p) {
+			before = 0;
+		}
+		
+		parent[child] = p;
+		next[child] = before;
+		prev[child] = before? prev[before] : last[p];
+		
+		(prev[child]? next[prev[child]] : first[p]) = child;
+		(before? prev[before] : last[p]) = child;
+		
+		flags[child] |= DIRTY;
+		invalidate(p);
+	}
+	
+	/**
+	 * Ask for a position and size. The node is put there right away, and
+	 *  stays there unless its parent has an order.
+	**/
+	void setGeometry(view_id_t id, int nx, int ny, uint nw, uint nh) {
+		if(!alive(id)) {
+			return;
+		}
+		
+		auto& b = box[id];
+		b.x = x[id] = nx;
+		b.y = y[id] = ny;
+		b.w = w[id] = nw;
+		b.h = h[id] = nh;
+		invalidate(id, true);
+	}
+	
+	void setLimits(
+		view_id_t id, uint min_w, uint min_h, uint max_w, uint max_h
+	) {
+		if(alive(id)) {
+			auto& b = box[id];
+			b.min_w = min_w;
+			b.min_h = min_h;
+			b.max_w = max_w;
+			b.max_h = max_h;
+			invalidate(id, true);
+		}
+	}
+	
+	void setEdges(view_id_t id, const Edges& padding, const Edges& margin) {
+		if(alive(id)) {
+			box[id].padding = padding;
+			box[id].margin = margin;
+			invalidate(id, true);
+		}
+	}
+	
+	void setOrder(view_id_t id, Order order) {
+		if(alive(id)) {
+			box[id].order = order;
+			invalidate(id);
+		}
+	}
+	
+	void setGrid(
+		view_id_t id,
+		const std::vector<Grid::Track>& cols,
+		const std::vector<Grid::Track>& rows
+	) {
+		if(alive(id)) {
+			auto& g = grids[id];
+			g.cols = cols;
+			g.rows = rows;
+			invalidate(id, true);
+		}
+	}
+	
+	void setCell(
+		view_id_t id, uint col, uint row, uint col_span, uint row_span
+	) {
+		if(alive(id)) {
+			const uint most = Grid::MAX_TRACKS;
+			auto& b = box[id];
+			b.col = std::min(col, most - 1);
+			b.row = std::min(row, most - 1);
+			b.col_span = std::min(col_span, most - b.col);
+			b.row_span = std::min(row_span, most - b.row);
+			invalidate(id, true);
+		}
+	}
+	
+	void setVisible(view_id_t id, bool v) {
+		if(alive(id)) {
+			flags[id] = v? flags[id]&~HIDDEN : flags[id]|HIDDEN;
+		}
+	}
+	
+	/**
+	 * Whether a node is the same size whatever it contains.
+	**/
+	bool fixedSize(view_id_t id) {
+		return box[id].w && box[id].h;
+	}
+	
+	/**
+	 * Whether where a node puts its children depends on their sizes,
+	 *  rather than only on its own size and how many there are.
+	**/
+	bool sizeDependent(view_id_t id) {
+		uint8_t order = box[id].order;
+		return order == FLOW || order == GRID || order == NONE;
+	}
+	
+	/**
+	 * Mark a node as having to be laid out again. Its size may change,
+	 *  so a parent arranging by size has to be too, and so on up until
+	 *  a node's size can't change or its parent doesn't care. Asked is
+	 *  true if what the node itself asked for changed, so even a fixed
+	 *  size may not be the same.
+	**/
+	void invalidate(view_id_t id, bool asked=false) {
+		flags[id] |= DIRTY;
+		++gen[id];
+		
+		bool resized = asked || !fixedSize(id);
+		for(view_id_t p = parent[id]; p; p = parent[p]) {
+			if(resized) {
+				// What p measures as may have changed with it
+				++gen[p];
+			}
+			
+			if(resized && sizeDependent(p)) {
+				flags[p] |= DIRTY;
+			}
+			else if(!resized && (flags[p]&CHILD_DIRTY)) {
+				// Everything above was marked by an earlier change
+				break;
+			}
+			flags[p] |= CHILD_DIRTY;
+			resized = resized && !fixedSize(p);
+		}
+	}
+	
+	static uint inset(uint v, int a, int b) {
+		int r = (int)v - a - b;
+		return r > 0? r : 0;
+	}
+	
+	static uint fit(uint v, uint lo, uint hi) {
+		if(hi && v > hi) {
+			v = hi;
+		}
+		return v < lo? lo : v;
+	}
+	
+	/**
+	 * Walk the children of a flow node width wide, calling f with each
+	 *  and the box it gets, margins included. Children go left to right
+	 *  in lines, wrapping when one would pass the right edge unless it's
+	 *  first on its line. Returns the size of the content.
+	**/
+	template<typename F>
+	Size flow(view_id_t id, uint width, F f) {
+		auto& pad = box[id].padding;
+		uint inner = inset(width, pad.left, pad.right);
+		int
+			left = pad.left, right = left + (int)inner,
+			cx = left, cy = pad.top, extent = left;
+		uint line = 0;
+		
+		for(view_id_t c = first[id]; c; c = next[c]) {
+			auto& m = box[c].margin;
+			Size s = measure(c, inset(inner, m.left, m.right));
+			uint
+				ow = s.w + m.left + m.right,
+				oh = s.h + m.top + m.bottom;
+			
+			if(cx > left && cx + (int)ow > right) {
+				cx = left;
+				cy += line;
+				line = 0;
+			}
+			
+			f(c, cx, cy, ow, oh);
+			
+			cx += ow;
+			extent = std::max(extent, cx);
+			line = std::max(line, oh);
+		}
+		
+		return Size{
+			(uint)std::max(extent + pad.right, 0),
+			(uint)std::max(cy + (int)line + pad.bottom, 0)
+		};
+	}
+	
+	/**
+	 * The size a node would take given width to fit in, margins not
+	 *  included. This is cached until the node's generation changes,
+	 *  and for any width if the size doesn't depend on it, so wrapping
+	 *  a flow again mostly doesn't measure its children again.
+	**/
+	Size measure(view_id_t id, uint width) {
+		uint8_t f = flags[id];
+		if(
+			(f&MEASURED) && measured_gen[id] == gen[id] &&
+			((f&WIDTH_FREE) || measured_for[id] == width)
+		) {
+			return measured[id];
+		}
+		
+		bool free = true;
+		Size s = measureContent(id, width, free);
+		
+		flags[id] = (f&~WIDTH_FREE)|MEASURED|(free? WIDTH_FREE : 0);
+		measured[id] = s;
+		measured_for[id] = width;
+		measured_gen[id] = gen[id];
+		return s;
+	}
+	
+	/**
+	 * Measure a node, clearing free if the size depends on width.
+	**/
+	Size measureContent(view_id_t id, uint width, bool& free) {
+		auto& b = box[id];
+		if(fixedSize(id)) {
+			return Size{
+				fit(b.w, b.min_w, b.max_w), fit(b.h, b.min_h, b.max_h)
+			};
+		}
+		
+		// Nothing inside sees the width given if the node has its own
+		uint inner = b.w? b.w : width;
+		Size s{0, 0};
+		
+		if(b.order == FLOW) {
+			s = flow(id, inner, [](view_id_t, int, int, uint, uint) {});
+			free = b.w;
+		}
+		else if(b.order == GRID) {
+			// Fractions get no more than they need, which is nothing
+			auto& g = baseGrid(id, inner);
+			for(auto v : g.base_cols) {
+				s.w += v;
+			}
+			for(auto v : g.base_rows) {
+				s.h += v;
+			}
+			s.w += b.padding.left + b.padding.right;
+			s.h += b.padding.top + b.padding.bottom;
+			free = b.w;
+		}
+		else {
+			uint
+				cw = inset(inner, b.padding.left, b.padding.right),
+				n = 0, i = 0;
+			
+			// Rows give each child only its share of the width, as
+			//  arrange does
+			if(b.order == ROW) {
+				for(view_id_t c = first[id]; c; c = next[c]) {
+					++n;
+				}
+			}
+			
+			for(view_id_t c = first[id]; c; c = next[c], ++i) {
+				auto& cb = box[c];
+				auto& m = cb.margin;
+				uint avail = n?
+					(uint)((uint64_t)cw*(i + 1)/n - (uint64_t)cw*i/n) : cw;
+				Size cs = measure(c, inset(avail, m.left, m.right));
+				uint
+					ow = cs.w + m.left + m.right,
+					oh = cs.h + m.top + m.bottom;
+				
+				if(!b.w && !(flags[c]&WIDTH_FREE)) {
+					free = false;
+				}
+				
+				switch((Order)b.order) {
+					// Far enough to reach each child where it asked to be
+					case NONE:
+						s.w = std::max(s.w, inset(ow, -cb.x, 0));
+						s.h = std::max(s.h, inset(oh, -cb.y, 0));
+						break;
+					
+					case STACK:
+					case FLOW:
+					case GRID:
+						s.w = std::max(s.w, ow);
+						s.h = std::max(s.h, oh);
+						break;
+					
+					case ROW:
+						s.w += ow;
+						s.h = std::max(s.h, oh);
+						break;
+					
+					case COLUMN:
+						s.w = std::max(s.w, ow);
+						s.h += oh;
+						break;
+				}
+			}
+			
+			s.w += b.padding.left + b.padding.right;
+			s.h += b.padding.top + b.padding.bottom;
+		}
+		
+		return Size{
+			fit(b.w? b.w : s.w, b.min_w, b.max_w),
+			fit(b.h? b.h : s.h, b.min_h, b.max_h)
+		};
+	}
+	
+	/**
+	 * Lay out the tree under root as root's size, appending id, x, y, w,
+	 *  h for every node whose geometry changed.
+	**/
+	void layout(view_id_t root, uint rw, uint rh, std::vector<int>& out) {
+		if(!alive(root)) {
+			return;
+		}
+		
+		bool resized = rw != w[root] || rh != h[root];
+		w[root] = rw;
+		h[root] = rh;
+		
+		relayout(root, resized, out);
+	}
+	
+	/**
+	 * Give a node the box from its parent, margins included.
+	**/
+	void place(
+		view_id_t id, int sx, int sy, uint sw, uint sh, std::vector<int>& out
+	) {
+		auto& b = box[id];
+		slot_x[id] = sx;
+		slot_y[id] = sy;
+		slot_w[id] = sw;
+		slot_h[id] = sh;
+		
+		int nx = sx + b.margin.left, ny = sy + b.margin.top;
+		uint
+			nw = b.w? b.w : inset(sw, b.margin.left, b.margin.right),
+			nh = b.h? b.h : inset(sh, b.margin.top, b.margin.bottom);
+		nw = fit(nw, b.min_w, b.max_w);
+		nh = fit(nh, b.min_h, b.max_h);
+		
+		bool resized = nw != w[id] || nh != h[id];
+		if(resized || nx != x[id] || ny != y[id]) {
+			x[id] = nx;
+			y[id] = ny;
+			w[id] = nw;
+			h[id] = nh;
+			out.insert(out.end(), {(int)id, nx, ny, (int)nw, (int)nh});
+		}
+		
+		relayout(id, resized, out);
+	}
+	
+	/**
+	 * Arrange a node's children if it changed size or is dirty, or else
+	 *  visit only the children with something dirty under them.
+	**/
+	void relayout(view_id_t id, bool resized, std::vector<int>& out) {
+		if(resized || (flags[id]&DIRTY)) {
+			arrange(id, out);
+		}
+		else if(flags[id]&CHILD_DIRTY) {
+			for(view_id_t c = first[id]; c; c = next[c]) {
+				if(flags[c]&(DIRTY|CHILD_DIRTY)) {
+					place(c, slot_x[c], slot_y[c], slot_w[c], slot_h[c], out);
+				}
+			}
+		}
+		
+		flags[id] &= ~(DIRTY|CHILD_DIRTY);
+	}
+	
+	void arrange(view_id_t id, std::vector<int>& out) {
+		auto& b = box[id];
+		int left = b.padding.left, top = b.padding.top;
+		uint
+			cw = inset(w[id], b.padding.left, b.padding.right),
+			ch = inset(h[id], b.padding.top, b.padding.bottom),
+			n = 0, i = 0;
+		
+		for(view_id_t c = first[id]; c; c = next[c]) {
+			++n;
+		}
+		
+		switch((Order)b.order) {
+			case NONE:
+				for(view_id_t c = first[id]; c; c = next[c]) {
+					auto& cb = box[c];
+					auto& m = cb.margin;
+					Size s = measure(c, inset(cw, m.left, m.right));
+					place(
+						c, cb.x - m.left, cb.y - m.top,
+						s.w + m.left + m.right, s.h + m.top + m.bottom, out
+					);
+				}
+				break;
+			
+			case STACK:
+				for(view_id_t c = first[id]; c; c = next[c]) {
+					place(c, left, top, cw, ch, out);
+				}
+				break;
+			
+			// Equal shares, with the remainder spread between them
+			case ROW:
+				for(view_id_t c = first[id]; c; c = next[c], ++i) {
+					uint
+						x0 = (uint64_t)cw*i/n,
+						x1 = (uint64_t)cw*(i + 1)/n;
+					place(c, left + (int)x0, top, x1 - x0, ch, out);
+				}
+				break;
+			
+			case COLUMN:
+				for(view_id_t c = first[id]; c; c = next[c], ++i) {
+					uint
+						y0 = (uint64_t)ch*i/n,
+						y1 = (uint64_t)ch*(i + 1)/n;
+					place(c, left, top + (int)y0, cw, y1 - y0, out);
+				}
+				break;
+			
+			case FLOW:
+				flow(id, w[id], [&](
+					view_id_t c, int cx, int cy, uint ow, uint oh
+				) {
+					place(c, cx, cy, ow, oh, out);
+				});
+				break;
+			
+			case GRID: {
+				// The map's nodes stay put while children add their own
+				auto& g = baseGrid(id, w[id]);
+				shareTracks(g.cols, g.base_cols, left, cw, g.col_at);
+				shareTracks(g.rows, g.base_rows, top, ch, g.row_at);
+				
+				auto& ca = g.col_at;
+				auto& ra = g.row_at;
+				uint* cell = g.cells.data();
+				for(view_id_t c = first[id]; c; c = next[c], cell += 4) {
+					uint c0 = cell[0], c1 = c0 + cell[2];
+					uint r0 = cell[1], r1 = r0 + cell[3];
+					place(
+						c, ca[c0], ra[r0], ca[c1] - ca[c0], ra[r1] - ra[r0],
+						out
+					);
+				}
+				break;
+			}
+		}
+	}
+	
+	/**
+	 * Place the children of a grid and size its tracks, short of sharing
+	 *  out what's left to fractions. This is one pass over the children
+	 *  plus one over those spanning several tracks, and is kept until
+	 *  the grid's generation or width changes, which a child's size
+	 *  changing does.
+	**/
+	Grid& baseGrid(view_id_t id, uint width) {
+		auto& g = grids[id];
+		if(g.based && g.based_gen == gen[id] && g.based_w == width) {
+			return g;
+		}
+		
+		auto& pad = box[id].padding;
+		uint
+			inner = inset(width, pad.left, pad.right),
+			wrap = std::max<uint>(g.cols.size(), 1),
+			ncols = g.cols.size(), nrows = g.rows.size(),
+			ac = 0, ar = 0;
+		
+		// Children placed explicitly claim their cells first, row major
+		//  over the columns given
+		std::vector<bool> taken;
+		for(view_id_t c = first[id]; c; c = next[c]) {
+			auto& cb = box[c];
+			if(!cb.col_span) {
+				continue;
+			}
+			
+			uint
+				c1 = std::min<uint>(cb.col + cb.col_span, wrap),
+				r1 = cb.row + std::max<uint>(cb.row_span, 1);
+			for(uint r = cb.row; r < r1; ++r) {
+				for(uint k = cb.col; k < c1; ++k) {
+					size_t at = (size_t)r*wrap + k;
+					if(at >= taken.size()) {
+						taken.resize((size_t)(r + 1)*wrap);
+					}
+					taken[at] = true;
+				}
+			}
+		}
+		
+		// Auto placed children fill the free cells, row by row
+		g.cells.clear();
+		for(view_id_t c = first[id]; c; c = next[c]) {
+			auto& cb = box[c];
+			uint col, row, cs, rs;
+			if(cb.col_span) {
+				col = cb.col;
+				row = cb.row;
+				cs = cb.col_span;
+				rs = std::max<uint>(cb.row_span, 1);
+			}
+			else {
+				for(;; ++ac) {
+					if(ac >= wrap) {
+						ac = 0;
+						++ar;
+					}
+					size_t at = (size_t)ar*wrap + ac;
+					if(at >= taken.size() || !taken[at]) {
+						break;
+					}
+				}
+				col = ac++;
+				row = ar;
+				cs = rs = 1;
+			}
+			
+			g.cells.insert(g.cells.end(), {col, row, cs, rs});
+			ncols = std::max(ncols, col + cs);
+			nrows = std::max(nrows, row + rs);
+		}
+		
+		g.base_cols.assign(ncols, 0);
+		g.base_rows.assign(nrows, 0);
+		for(size_t i = 0; i < g.cols.size(); ++i) {
+			if(g.cols[i].kind == Grid::FIXED) {
+				g.base_cols[i] = g.cols[i].value;
+			}
+		}
+		for(size_t i = 0; i < g.rows.size(); ++i) {
+			if(g.rows[i].kind == Grid::FIXED) {
+				g.base_rows[i] = g.rows[i].value;
+			}
+		}
+		
+		// Single track cells grow their track if it fits its content,
+		//  those spanning more wait until all of those are in
+		struct Span {
+			uint* cell;
+			uint ow, oh;
+		};
+		std::vector<Span> spans;
+		
+		uint* cell = g.cells.data();
+		for(view_id_t c = first[id]; c; c = next[c], cell += 4) {
+			auto& m = box[c].margin;
+			Size s = measure(c, inset(inner, m.left, m.right));
+			uint
+				ow = s.w + m.left + m.right,
+				oh = s.h + m.top + m.bottom;
+			
+			if(cell[2] == 1) {
+				fitTrack(g.cols, g.base_cols, cell[0], ow);
+			}
+			if(cell[3] == 1) {
+				fitTrack(g.rows, g.base_rows, cell[1], oh);
+			}
+			if(cell[2] > 1 || cell[3] > 1) {
+				spans.push_back(Span{cell, ow, oh});
+			}
+		}
+		
+		for(auto& sp : spans) {
+			if(sp.cell[2] > 1) {
+				spreadTracks(
+					g.cols, g.base_cols, sp.cell[0], sp.cell[2], sp.ow
+				);
+			}
+			if(sp.cell[3] > 1) {
+				spreadTracks(
+					g.rows, g.base_rows, sp.cell[1], sp.cell[3], sp.oh
+				);
+			}
+		}
+		
+		g.based = true;
+		g.based_gen = gen[id];
+		g.based_w = width;
+		return g;
+	}
+	
+	static void fitTrack(
+		const std::vector<Grid::Track>& tracks, std::vector<uint>& base,
+		uint i, uint size
+	) {
+		if(Grid::kindAt(tracks, i) == Grid::AUTO) {
+			base[i] = std::max(base[i], size);
+		}
+	}
+	
+	/**
+	 * Grow the content sized tracks under a spanning cell evenly until
+	 *  they cover it.
+	**/
+	static void spreadTracks(
+		const std::vector<Grid::Track>& tracks, std::vector<uint>& base,
+		uint start, uint span, uint size
+	) {
+		uint have = 0, autos = 0;
+		for(uint i = start; i < start + span; ++i) {
+			have += base[i];
+			autos += Grid::kindAt(tracks, i) == Grid::AUTO;
+		}
+		if(have >= size || !autos) {
+			return;
+		}
+		
+		uint extra = size - have, k = 0;
+		for(uint i = start; i < start + span; ++i) {
+			if(Grid::kindAt(tracks, i) == Grid::AUTO) {
+				base[i] += extra/autos + (k++ < extra%autos);
+			}
+		}
+	}
+	
+	/**
+	 * Share what's left of avail between the fraction tracks by weight,
+	 *  and set where each track starts.
+	**/
+	static void shareTracks(
+		const std::vector<Grid::Track>& tracks,
+		const std::vector<uint>& base, int start, uint avail,
+		std::vector<int>& at
+	) {
+		uint used = 0;
+		uint64_t total = 0;
+		for(size_t i = 0; i < base.size(); ++i) {
+			used += base[i];
+			if(Grid::kindAt(tracks, i) == Grid::FRACTION) {
+				total += tracks[i].value;
+			}
+		}
+		uint64_t left = avail > used? avail - used : 0;
+		
+		at.resize(base.size() + 1);
+		at[0] = start;
+		
+		// Shares are cut from a running total so the remainder spreads
+		uint64_t weight = 0;
+		uint given = 0;
+		for(size_t i = 0; i < base.size(); ++i) {
+			uint size = base[i];
+			if(total && Grid::kindAt(tracks, i) == Grid::FRACTION) {
+				weight += tracks[i].value;
+				uint upto = left*weight/total;
+				size += upto - given;
+				given = upto;
+			}
+			at[i + 1] = at[i] + (int)size;
+		}
+	}
+	
+	/**
+	 * Where a node is relative to the root of its tree.
+	**/
+	void offset(view_id_t id, int& ox, int& oy) {
+		ox = oy = 0;
+		for(; parent[id]; id = parent[id]) {
+			ox += x[id];
+			oy += y[id];
+		}
+	}
+	
+	bool contains(view_id_t id, int px, int py) {
+		return px >= x[id] && py >= y[id] &&
+			px < x[id] + (int)w[id] && py < y[id] + (int)h[id];
+	}
+	
+	/**
+	 * The deepest visible windowless node under a point relative to
+	 *  root, or 0 if it's only over root itself. Later siblings are drawn
+	 *  on top, so they're checked first.
+	**/
+	view_id_t hitTest(view_id_t root, int px, int py) {
+		if(!alive(root)) {
+			return 0;
+		}
+		
+		view_id_t hit = 0;
+		for(view_id_t n = root; n;) {
+			view_id_t found = 0;
+			
+			for(view_id_t c = last[n]; c; c = prev[c]) {
+				if(!(flags[c]&(HIDDEN|WINDOWED)) && contains(c, px, py)) {
+					found = c;
+					break;
+				}
+			}
+			if(!found) {
+				break;
+			}
+			
+			hit = found;
+			px -= x[found];
+			py -= y[found];
+			n = found;
+		}
+		return hit;
+	}
+	
+	/**
+	 * Visible windowless nodes under root in paint order, as id, x, y
+	 *  triples with x, y relative to root. Nodes clip their children, so
+	 *  a subtree outside the clip region is skipped whole.
+	**/
+	void paintList(
+		view_id_t root, const Region* clip, std::vector<int>& out
+	) {
+		if(!alive(root)) {
+			return;
+		}
+		
+		struct Visit {
+			view_id_t id;
+			int ox, oy;
+		};
+		std::vector<Visit> stack;
+		
+		auto push_children = [&](view_id_t n, int ox, int oy) {
+			// Pushed last to first so they come off first to last
+			for(view_id_t c = last[n]; c; c = prev[c]) {
+				stack.push_back(Visit{c, ox, oy});
+			}
+		};
+		push_children(root, 0, 0);
+		
+		while(stack.size()) {
+			Visit v = stack.back();
+			stack.pop_back();
+			
+			view_id_t n = v.id;
+			int nx = v.ox + x[n], ny = v.oy + y[n];
+			
+			if(flags[n]&(HIDDEN|WINDOWED)) {
+				continue;
+			}
+			if(clip && !clip->intersects(nx, ny, w[n], h[n])) {
+				continue;
+			}
+			
+			out.push_back(n);
+			out.push_back(nx);
+			out.push_back(ny);
+			
+			push_children(n, nx, ny);
+		}
+	}
+};
+
+static ViewTree views;
@@ -0,0 +1,59 @@
+'use strict';
+
+// Checks which coordinates a moved Canvas offsets. Only the native
+//  calls are looked at, so no window is needed.
+
+const
+	{Canvas} = require("./lib/window"),
+	{defineNative} = require("./lib/native");
+
+let sent = null;
+
+let g = Object.create(Canvas.prototype);
+g.x = 10;
+g.y = 20;
+defineNative(g, {
+	drawPoints(rel, ...points) {
+		sent = points;
+	},
+	drawLines(rel, ...lines) {
+		sent = lines;
+	}
+});
+
+function check(what, got, want) {
+	got = JSON.stringify(got);
+	want = JSON.stringify(want);
+	console.log(got === want? "ok" : "Error:", what, got);
+	if(got !== want) {
+		process.exitCode = 1;
+	}
+}
+
+g.drawPoints(false, {x: 1, y: 2}, {x: 3, y: 4});
+check("points", sent, [{x: 11, y: 22}, {x: 13, y: 24}]);
+
+// Each relative point is from the last, so only the first moves
+g.drawPoints(true, {x: 1, y: 2}, {x: 3, y: 4});
+check("relative points", sent, [{x: 11, y: 22}, {x: 3, y: 4}]);
+
+g.drawPoints(true, Int16Array.of(1, 2, 3, 4));
+check("relative point array", Array.from(sent[0]), [11, 22, 3, 4]);
+
+g.drawLines(false, {x1: 1, y1: 2, x2: 3, y2: 4});
+check("lines", sent, [{x1: 11, y1: 22, x2: 13, y2: 24}]);
+
+// A relative line's end is from its own start
+g.drawLines(true, {x1: 1, y1: 2, x2: 3, y2: 4}, {x1: 5, y1: 6, x2: 7, y2: 8});
+check("relative lines", sent, [
+	{x1: 11, y1: 22, x2: 3, y2: 4},
+	{x1: 15, y1: 26, x2: 7, y2: 8}
+]);
+
+g.drawLines(true, Int16Array.of(1, 2, 3, 4, 5, 6, 7, 8));
+check("relative line array", Array.from(sent[0]), [
+	11, 22, 3, 4, 15, 26, 7, 8
+]);
+
+g.drawLines(false, Int16Array.of(1, 2, 3, 4));
+check("line array", Array.from(sent[0]), [11, 22, 13, 24]);
@@ -0,0 +1,111 @@
+'use strict';
+
+// Lays out small grids in the native view tree and compares where the
+//  children go with positions worked out by hand
+
+const {native} = require("./lib/native");
+
+// Track kinds and the grid order, as in viewtree.cc. Fractions are in
+//  thousandths.
+const AUTO = 0, FIXED = 1, FRACTION = 2, GRID = 5;
+
+/**
+ * Lay out a grid width wide with a child for each kid, given as
+ *  [w, h] to be placed automatically or [w, h, col, row, colSpan,
+ *  rowSpan]. Returns where each child went as [x, y].
+**/
+function layout(cols, rows, width, kids) {
+	let root = native.viewCreate(true);
+	native.viewSetOrder(root, GRID);
+	native.viewSetGrid(root, cols.length, ...[].concat(...cols, ...rows));
+	
+	let ids = kids.map(([w, h, ...cell]) => {
+		let id = native.viewCreate();
+		native.viewInsert(root, id);
+		native.viewSetGeometry(id, 0, 0, w, h);
+		if(cell.length) {
+			native.viewSetCell(id, ...cell);
+		}
+		return id;
+	});
+	
+	// Only what moved is reported, and everything starts at 0, 0
+	let moved = native.viewLayout(root, width, 1000), at = new Map();
+	for(let i = 0; i < moved.length; i += 5) {
+		at.set(moved[i], [moved[i + 1], moved[i + 2]]);
+	}
+	native.viewDestroy(root);
+	
+	return ids.map(id => at.get(id) || [0, 0]);
+}
+
+const cases = {
+	// 50 fixed, 30 for the widest in the auto column, 120 left over
+	"fixed, auto and fraction columns": {
+		cols: [[FIXED, 50], [AUTO, 0], [FRACTION, 1000]], rows: [],
+		width: 200,
+		kids: [[10, 5], [30, 8], [5, 5], [20, 4], [1, 1], [1, 1]],
+		want: [[0, 0], [50, 0], [80, 0], [0, 8], [50, 8], [80, 8]]
+	},
+	
+	// 1fr and 2fr of 100 make 33 and 67
+	"fractions by weight": {
+		cols: [[FRACTION, 1000], [FRACTION, 2000]], rows: [],
+		width: 100,
+		kids: [[1, 1], [1, 1], [1, 2]],
+		want: [[0, 0], [33, 0], [0, 1]]
+	},
+	
+	// Fixed tracks keep their size even with no room for them
+	"nothing left for fractions": {
+		cols: [[FIXED, 80], [FRACTION, 1000], [FIXED, 5]], rows: [],
+		width: 50,
+		kids: [[1, 1], [1, 1], [1, 1]],
+		want: [[0, 0], [80, 0], [80, 0]]
+	},
+	
+	// The explicit cell covers column 1 of rows 0 and 1 however early
+	//  it comes, and its 10 high span is split 5 and 5 over rows of 3
+	"explicit cell with auto placement around it": {
+		cols: [[AUTO, 0], [AUTO, 0], [AUTO, 0]], rows: [],
+		width: 100,
+		kids: [
+			[4, 3], [10, 10, 1, 0, 1, 2],
+			[4, 3], [4, 3], [4, 3], [4, 3]
+		],
+		want: [[0, 0], [4, 0], [14, 0], [0, 5], [14, 5], [0, 10]]
+	},
+	
+	// 42 across tracks of 3, 10 fixed and 2 leaves 27 for the two auto
+	//  ones, and the odd pixel goes to the first
+	"span spread over auto columns": {
+		cols: [[AUTO, 0], [FIXED, 10], [AUTO, 0]], rows: [],
+		width: 100,
+		kids: [[42, 2, 0, 0, 3, 1], [3, 1], [1, 1], [2, 1]],
+		want: [[0, 0], [0, 2], [17, 2], [27, 2]]
+	},
+	
+	// The first row is fixed, the implicit one after it fits its content
+	"fixed row then auto": {
+		cols: [[FRACTION, 1000]], rows: [[FIXED, 7]],
+		width: 20,
+		kids: [[5, 3], [5, 3], [5, 3]],
+		want: [[0, 0], [0, 7], [0, 10]]
+	}
+};
+
+for(let name in cases) {
+	let
+		{cols, rows, width, kids, want} = cases[name],
+		got = layout(cols, rows, width, kids);
+	
+	if(JSON.stringify(got) === JSON.stringify(want)) {
+		console.log("ok", name);
+	}
+	else {
+		console.log("Error:", name);
+		console.log("  got ", JSON.stringify(got));
+		console.log("  want", JSON.stringify(want));
+		process.exitCode = 1;
+	}
+}
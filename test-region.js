@@ -0,0 +1,162 @@
+'use strict';
+
+// Checks Region against a brute force set of pixels over a small area
+
+const {Region} = require("./lib/region");
+
+const SIZE = 32;
+
+function randomRect() {
+	let
+		x = Math.floor(Math.random()*(SIZE + 8)) - 4,
+		y = Math.floor(Math.random()*(SIZE + 8)) - 4;
+	
+	return [
+		x, y,
+		Math.floor(Math.random()*SIZE/2), Math.floor(Math.random()*SIZE/2)
+	];
+}
+
+function pixels(x, y, w, h) {
+	let out = new Set();
+	for(let j = y; j < y + h; ++j) {
+		for(let i = x; i < x + w; ++i) {
+			out.add(i + "," + j);
+		}
+	}
+	return out;
+}
+
+// The pixels a region covers, checking its boxes are banded as the
+//  server wants them along the way
+function covered(region) {
+	let rects = region.rects, out = new Set(), last = null, bands = [];
+	
+	for(let k = 0; k < rects.length; k += 4) {
+		let [x, y, w, h] = rects.subarray(k, k + 4);
+		if(w <= 0 || h <= 0) {
+			throw new Error("empty box");
+		}
+		
+		if(last && last[1] === y) {
+			if(last[3] !== h) {
+				throw new Error("band with mixed heights");
+			}
+			if(last[0] + last[2] >= x) {
+				throw new Error("boxes in a band touch or are out of order");
+			}
+			bands[bands.length - 1].spans.push(x, w);
+		}
+		else {
+			if(last && last[1] + last[3] > y) {
+				throw new Error("bands overlap or are out of order");
+			}
+			bands.push({y, h, spans: [x, w]});
+		}
+		last = [x, y, w, h];
+		
+		for(let p of pixels(x, y, w, h)) {
+			out.add(p);
+		}
+	}
+	
+	for(let i = 1; i < bands.length; ++i) {
+		let a = bands[i - 1], b = bands[i];
+		if(a.y + a.h === b.y && a.spans.join() === b.spans.join()) {
+			throw new Error("adjacent bands with the same spans");
+		}
+	}
+	
+	return out;
+}
+
+function same(a, b) {
+	if(a.size !== b.size) {
+		return false;
+	}
+	for(let p of a) {
+		if(!b.has(p)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+let failures = 0;
+
+for(let i = 0; i < 1000; ++i) {
+	let region = new Region(), model = new Set(), log = [];
+	
+	try {
+		for(let j = 0; j < 12; ++j) {
+			let
+				op = ['union', 'intersect', 'subtract', 'translate'][
+					Math.floor(Math.random()*4)
+				],
+				r = randomRect(),
+				px = pixels(...r);
+			
+			// Another region as the operand half the time
+			if(op !== 'translate' && Math.random() < 0.5) {
+				let other = new Region(...r).union(...randomRect());
+				px = covered(other);
+				log.push(op + " region " + Array.from(other.rects));
+				region[op](other);
+			}
+			else if(op === 'translate') {
+				let dx = r[0] >> 2, dy = r[1] >> 2;
+				log.push(op + " " + dx + " " + dy);
+				region.translate(dx, dy);
+				
+				let moved = new Set();
+				for(let p of model) {
+					let [x, y] = p.split(",").map(Number);
+					moved.add((x + dx) + "," + (y + dy));
+				}
+				model = moved;
+				continue;
+			}
+			else {
+				log.push(op + " " + r);
+				region[op](...r);
+			}
+			
+			switch(op) {
+				case 'union':
+					for(let p of px) {
+						model.add(p);
+					}
+					break;
+				case 'intersect':
+					model = new Set(Array.from(model).filter(p => px.has(p)));
+					break;
+				case 'subtract':
+					model = new Set(Array.from(model).filter(p => !px.has(p)));
+					break;
+			}
+		}
+		
+		if(!same(covered(region), model)) {
+			throw new Error("covers the wrong pixels");
+		}
+		if(region.empty !== (model.size === 0)) {
+			throw new Error("empty is wrong");
+		}
+		
+		let r = randomRect(), hit = false;
+		for(let p of pixels(...r)) {
+			hit = hit || model.has(p);
+		}
+		if(region.intersects(...r) !== hit) {
+			throw new Error("intersects(" + r + ") is wrong");
+		}
+	}
+	catch(e) {
+		++failures;
+		console.log("Error:", e.message);
+		console.log(log.join("\n"));
+	}
+}
+
+console.log("Failures:", failures);
+process.exitCode = failures? 1 : 0;
@@ -0,0 +1,66 @@
+'use strict';
+
+// Walks the native row index behind List through edits whose offsets
+//  were worked out by hand
+
+const
+	assert = require("assert"),
+	{native} = require("./lib/native");
+
+// Ten rows of the estimated 20
+let index = new native.NativeRowIndex(10, 20);
+assert.strictEqual(index.total(), 200);
+assert.strictEqual(index.offset(3), 60);
+assert.strictEqual(index.find(59), 2);
+assert.strictEqual(index.find(60), 3);
+
+// Row 2 at 50 pushes everything after it down 30
+index.setHeight(2, 50);
+assert.strictEqual(index.height(2), 50);
+assert.strictEqual(index.offset(3), 90);
+assert.strictEqual(index.total(), 230);
+assert.strictEqual(index.find(40), 2);
+assert.strictEqual(index.find(89), 2);
+assert.strictEqual(index.find(90), 3);
+
+// An empty row has nothing in it to find
+index.setHeight(0, 0);
+assert.strictEqual(index.offset(1), 0);
+assert.strictEqual(index.find(0), 0);
+assert.strictEqual(index.find(5), 1);
+assert.strictEqual(index.total(), 210);
+
+// Past the end is ignored, and finds clamp to the rows there are
+index.setHeight(10, 99);
+assert.strictEqual(index.total(), 210);
+assert.strictEqual(index.find(-3), 0);
+assert.strictEqual(index.find(1000), 9);
+
+// Heights kept through shrinking, new rows come back as the estimate
+index.setCount(4);
+assert.strictEqual(index.total(), 0 + 20 + 50 + 20);
+index.setCount(6);
+assert.strictEqual(index.total(), 90 + 20 + 20);
+assert.strictEqual(index.height(2), 50);
+assert.strictEqual(index.height(5), 20);
+
+// Every y in a list of mixed heights, against the rows' extents
+let heights = [20, 50, 0, 7, 20, 1];
+index = new native.NativeRowIndex(heights.length, 10);
+heights.forEach((h, i) => index.setHeight(i, h));
+
+for(let row = 0, top = 0; row < heights.length; top += heights[row++]) {
+	assert.strictEqual(index.offset(row), top);
+	for(let y = top; y < top + heights[row]; ++y) {
+		assert.strictEqual(index.find(y), row, "find(" + y + ")");
+	}
+}
+
+// Uniform lists don't keep anything per row, so they can be as long as
+//  the offsets go
+index = new native.NativeRowIndex(1e9, 30);
+assert.strictEqual(index.total(), 3e10);
+assert.strictEqual(index.offset(7e8), 2.1e10);
+assert.strictEqual(index.find(2.1e10 + 29), 7e8);
+
+console.log("ok");